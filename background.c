@@ -0,0 +1,240 @@
+#include "boone.h"
+
+// Lines read from every background job during one wakeup, written out together once it's over.
+static struct boone_output background_lines;
+
+// The terminal, duplicated so output still reaches it while stdout is redirected for a $(...).
+static int background_terminal = -1;
+
+static int background_running = 0;
+
+bool backgroundRequested(char** args)
+{
+    int last = 0;
+    while (args[last] != NULL)
+    {
+        last++;
+    }
+    if (last == 0)
+    {
+        return false;
+    }
+
+    char* arg = args[last - 1];
+    size_t len = strlen(arg);
+    if (len == 0 || arg[len - 1] != '&')
+    {
+        return false;
+    }
+
+    if (len == 1)
+    {
+        args[last - 1] = NULL;
+    }
+    else
+    {
+        arg[len - 1] = '\0';
+    }
+    return true;
+}
+
+static void backgroundFlush(void)
+{
+    if (background_lines.len == 0)
+    {
+        return;
+    }
+
+    struct boone_output screen = { 0 };
+    editorPrintAbove(&screen, background_lines.data, background_lines.len);
+    write(background_terminal != -1 ? background_terminal : STDOUT_FILENO, screen.data, screen.len);
+
+    outputFree(&screen);
+    background_lines.len = 0;
+}
+
+static void backgroundAddLine(struct job* job, const char* text, size_t len)
+{
+    outputPrintf(&background_lines, "[%d] ", jobId(job));
+    if (job->output_len > 0)
+    {
+        outputWrite(&background_lines, job->output_line, job->output_len);
+        job->output_len = 0;
+    }
+    outputWrite(&background_lines, text, len);
+    outputWrite(&background_lines, "\n", 1);
+}
+
+/**
+ * Queues every complete line of data, keeping the unfinished last one with the job.
+ * Lines longer than BACKGROUND_LINE_MAX are queued in pieces of that size.
+ */
+static void backgroundSplit(struct job* job, const char* data, size_t len)
+{
+    const char* end = data + len;
+    while (data < end)
+    {
+        size_t room = BACKGROUND_LINE_MAX - job->output_len;
+        size_t left = end - data;
+        const char* newline = memchr(data, '\n', left <= room ? left : room + 1);
+        if (newline != NULL)
+        {
+            backgroundAddLine(job, data, newline - data);
+            data = newline + 1;
+        }
+        else if (left > room)
+        {
+            backgroundAddLine(job, data, room);
+            data += room;
+        }
+        else
+        {
+            if (job->output_len + left > job->output_cap)
+            {
+                size_t cap = job->output_len + left;
+                char* grown = realloc(job->output_line, cap);
+                if (grown == NULL)
+                {
+                    return;
+                }
+                job->output_line = grown;
+                job->output_cap = cap;
+            }
+            memcpy(job->output_line + job->output_len, data, left);
+            job->output_len += left;
+            return;
+        }
+    }
+}
+
+static void backgroundCloseOutput(struct job* job)
+{
+    if (job->output_len > 0)
+    {
+        backgroundAddLine(job, "", 0);
+    }
+
+    eventRemove(job->output_fd);
+    close(job->output_fd);
+    job->output_fd = -1;
+}
+
+// Reads what is waiting in the job's pipe. Returns 1 if it read some, 0 if it's empty and -1 once every writer closed it.
+static int backgroundRead(struct job* job)
+{
+    static char chunk[BACKGROUND_READ_CHUNK];
+
+    ssize_t nread = read(job->output_fd, chunk, sizeof(chunk));
+    if (nread > 0)
+    {
+        backgroundSplit(job, chunk, nread);
+        return 1;
+    }
+    return nread == -1 && (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+}
+
+static void backgroundReadable(int fd, void* data)
+{
+    struct job* job = data;
+    if (backgroundRead(job) == -1)
+    {
+        backgroundCloseOutput(job);
+    }
+}
+
+struct job* backgroundLaunch(char** args)
+{
+    bool prefix = VARS_GET("BOONE_PREFIX_JOB_OUTPUT") != NULL;
+    int output[2] = { -1, -1 };
+
+    if (prefix && background_terminal == -1)
+    {
+        background_terminal = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+        eventSetFlush(backgroundFlush);
+    }
+    if (prefix && pipe2(output, O_CLOEXEC) == -1)
+    {
+        perror("Could not create job output pipe! ");
+        prefix = false;
+    }
+
+    // Background jobs mustn't read the keys meant for the prompt.
+    spawn_stdin = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    spawn_stdout = output[1];
+    spawn_stderr = output[1];
+
+    struct job* job = spawn_process(args, &background_policy);
+
+    close(spawn_stdin);
+    spawn_stdin = -1;
+    spawn_stdout = -1;
+    spawn_stderr = -1;
+    if (prefix)
+    {
+        close(output[1]);
+    }
+
+    if (job == NULL)
+    {
+        if (prefix)
+        {
+            close(output[0]);
+        }
+        return NULL;
+    }
+
+    job->background = true;
+    background_running++;
+    if (prefix)
+    {
+        fcntl(output[0], F_SETFL, O_NONBLOCK);
+        job->output_fd = output[0];
+        eventAdd(output[0], backgroundReadable, job);
+    }
+
+    printf("\r[%d] %d\n", jobId(job), job->pid);
+    return job;
+}
+
+void backgroundCollect(void)
+{
+    if (background_running == 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < JOB_MAX; i++)
+    {
+        struct job* job = &jobs[i];
+        if (job->state != JOB_DONE || !job->background)
+        {
+            continue;
+        }
+
+        // Whatever the job wrote before exiting goes out before its status.
+        if (job->output_fd != -1)
+        {
+            while (backgroundRead(job) == 1);
+            backgroundCloseOutput(job);
+        }
+
+        if (WIFSIGNALED(job->status))
+        {
+            outputPrintf(&background_lines, "[%d] Killed by signal %d: %s\n", i, WTERMSIG(job->status), job->command);
+        }
+        else if (WEXITSTATUS(job->status) != 0)
+        {
+            outputPrintf(&background_lines, "[%d] Exited with status %d: %s\n", i, WEXITSTATUS(job->status), job->command);
+        }
+        else
+        {
+            outputPrintf(&background_lines, "[%d] Done: %s\n", i, job->command);
+        }
+
+        record_job(job);
+        jobFree(job);
+        background_running--;
+    }
+
+    backgroundFlush();
+}
@@ -0,0 +1,28 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+#include <stdbool.h>
+#include "jobs.h"
+
+#define BACKGROUND_READ_CHUNK 65536
+
+// A line without a newline is printed anyway once it gets this long.
+#define BACKGROUND_LINE_MAX 4096
+
+/**
+ * Strips a trailing & from the arguments, either on its own or at the end of
+ * the last one. Returns true if there was one.
+ */
+bool backgroundRequested(char** args);
+
+/**
+ * Starts a program as a running background job with standard input from /dev/null.
+ * When BOONE_PREFIX_JOB_OUTPUT is set its standard output and error come back through
+ * a pipe and are printed above the prompt a line at a time, prefixed with the job id.
+ */
+struct job* backgroundLaunch(char** args);
+
+// Reports the background jobs that finished and frees them. Called before each prompt is drawn.
+void backgroundCollect(void);
+
+#endif
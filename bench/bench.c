@@ -0,0 +1,322 @@
+/**
+ * Microbenchmarks for the editor, tokenizer and completion functions, linked
+ * against libboone.a. Run with `make bench`. Directories of up to
+ * BOONE_BENCH_MAX_ENTRIES files (1M by default) are created under /tmp.
+ */
+#include "../boone.h"
+
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+#define BENCH_MAX_ENTRIES 1000000
+
+// Roughly how many bytes each benchmark chews through, which decides how many iterations it gets.
+#define BENCH_BYTES (16 * 1024 * 1024)
+
+// Size of the line the end to end benchmark edits and executes.
+#define BENCH_LONG_LINE (2 * 1024 * 1024)
+
+// Linux allows the arguments of a program a quarter of the stack limit.
+#define BENCH_STACK_LIMIT (64 * 1024 * 1024)
+
+static const size_t bench_line_sizes[] = { 10, 1000, 100000, 1000000 };
+static const size_t bench_dir_sizes[] = { 10, 1000, 100000, 1000000 };
+
+static double benchNow(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static void benchReport(const char* name, size_t size, long iterations, double seconds)
+{
+    printf("%-22s %10zu %10ld %14.3f us/op\n", name, size, iterations, seconds * 1e6 / iterations);
+}
+
+static long benchIterations(size_t size)
+{
+    long iterations = BENCH_BYTES / size;
+    return iterations < 1 ? 1 : iterations > 100000 ? 100000 : iterations;
+}
+
+// Builds a line of len bytes made of short words, like a generated file list.
+static char* benchLine(size_t len)
+{
+    static const char words[] = "src/editor.c ";
+    char* line = malloc(len + 1);
+    for (size_t i = 0; i < len; i++)
+    {
+        line[i] = words[i % (sizeof(words) - 1)];
+    }
+    line[len] = '\0';
+    return line;
+}
+
+// Both tokenizers write into the line, so every iteration gets a fresh copy. The copy is part of the timing.
+static void benchTokenizers(void)
+{
+    for (size_t i = 0; i < sizeof(bench_line_sizes) / sizeof(size_t); i++)
+    {
+        size_t len = bench_line_sizes[i];
+        long iterations = benchIterations(len);
+        char* line = benchLine(len);
+        char* copy = malloc(len + 1);
+
+        double start = benchNow();
+        for (long j = 0; j < iterations; j++)
+        {
+            memcpy(copy, line, len + 1);
+            free(editorGetArgs(copy));
+        }
+        benchReport("editorGetArgs", len, iterations, benchNow() - start);
+
+        start = benchNow();
+        for (long j = 0; j < iterations; j++)
+        {
+            memcpy(copy, line, len + 1);
+            free(lexerExpand(copy));
+        }
+        benchReport("lexerExpand", len, iterations, benchNow() - start);
+
+        free(copy);
+        free(line);
+    }
+}
+
+// Types a character in the middle of the line and backspaces over it again.
+static void benchInsertDelete(void)
+{
+    for (size_t i = 0; i < sizeof(bench_line_sizes) / sizeof(size_t); i++)
+    {
+        size_t len = bench_line_sizes[i];
+        long iterations = benchIterations(len);
+        char* command = benchLine(len);
+
+        editor_state.cwd_str_len = 0;
+        editor_state.x = len / 2;
+
+        double start = benchNow();
+        for (long j = 0; j < iterations; j++)
+        {
+            editorAddCharacter(&command, 'x');
+            editorDeleteCharacter(&command, false);
+        }
+        benchReport("insert + backspace", len, iterations, benchNow() - start);
+
+        free(command);
+    }
+}
+
+/**
+ * Takes a 2 MB line through every stage of read_user_line: pasting it in terminal sized
+ * chunks, editing it in the middle, the completion hint, expanding it and running it.
+ * It runs in root, where a src directory gives the last word of the line something to complete to.
+ */
+static void benchLongLine(const char* root)
+{
+    char src[PATH_MAX];
+    char editor_c[PATH_MAX];
+    snprintf(src, sizeof(src), "%s/src", root);
+    snprintf(editor_c, sizeof(editor_c), "%s/src/editor.c", root);
+    int fd = -1;
+    if (mkdir(src, 0700) == -1 || (fd = open(editor_c, O_CREAT | O_WRONLY, 0600)) == -1 || chdir(root) == -1)
+    {
+        perror("Could not create benchmark directory! ");
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return;
+    }
+    close(fd);
+    promptChangedDirectory();
+
+    char* line = benchLine(BENCH_LONG_LINE);
+    memcpy(line, "true ", 5);
+
+    editor_state.cwd_str_len = 0;
+    editor_state.x = 0;
+    char* command = strdup("");
+
+    double start = benchNow();
+    for (size_t pos = 0; pos < BENCH_LONG_LINE; pos += EDITOR_READ_CHUNK)
+    {
+        size_t len = BENCH_LONG_LINE - pos < EDITOR_READ_CHUNK ? BENCH_LONG_LINE - pos : EDITOR_READ_CHUNK;
+        editorInsertText(&command, line + pos, len);
+    }
+    benchReport("paste", BENCH_LONG_LINE, 1, benchNow() - start);
+
+    long iterations = benchIterations(BENCH_LONG_LINE);
+    editor_state.x = BENCH_LONG_LINE / 2;
+    start = benchNow();
+    for (long j = 0; j < iterations; j++)
+    {
+        editorAddCharacter(&command, 'x');
+        editorDeleteCharacter(&command, false);
+    }
+    benchReport("edit", BENCH_LONG_LINE, iterations, benchNow() - start);
+
+    start = benchNow();
+    for (long j = 0; j < iterations; j++)
+    {
+        char* hint = strdup(command);
+        editorTabComplete(&hint, true);
+        free(hint);
+    }
+    benchReport("completion hint", BENCH_LONG_LINE, iterations, benchNow() - start);
+
+    start = benchNow();
+    char** argv = lexerExpand(command);
+    benchReport("expand", BENCH_LONG_LINE, 1, benchNow() - start);
+
+    struct rlimit stack;
+    getrlimit(RLIMIT_STACK, &stack);
+    if (stack.rlim_cur != RLIM_INFINITY && stack.rlim_cur < BENCH_STACK_LIMIT)
+    {
+        stack.rlim_cur = stack.rlim_max == RLIM_INFINITY || stack.rlim_max > BENCH_STACK_LIMIT ?
+                         BENCH_STACK_LIMIT : stack.rlim_max;
+        setrlimit(RLIMIT_STACK, &stack);
+    }
+
+    start = benchNow();
+    struct job* job = spawn_process(argv, NULL);
+    int status = -1;
+    if (job != NULL)
+    {
+        waitpid(job->pid, &status, 0);
+        jobFree(job);
+    }
+    double elapsed = benchNow() - start;
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+    {
+        benchReport("execute", BENCH_LONG_LINE, 1, elapsed);
+    }
+    else
+    {
+        printf("%-22s %10d %10s %17s\n", "execute", BENCH_LONG_LINE, "-", "failed");
+    }
+
+    free(argv);
+    free(command);
+    free(line);
+
+    unlink(editor_c);
+    rmdir(src);
+}
+
+static int benchMakeDir(const char* dir, size_t entries)
+{
+    if (mkdir(dir, 0700) == -1)
+    {
+        perror("Could not create benchmark directory! ");
+        return -1;
+    }
+
+    char path[PATH_MAX];
+    for (size_t i = 0; i < entries; i++)
+    {
+        snprintf(path, sizeof(path), "%s/file%07zu", dir, i);
+        int fd = open(path, O_CREAT | O_WRONLY, 0600);
+        if (fd == -1)
+        {
+            perror("Could not create benchmark file! ");
+            return -1;
+        }
+        close(fd);
+    }
+
+    snprintf(path, sizeof(path), "%s/unique_target", dir);
+    mkdir(path, 0700);
+    return 0;
+}
+
+static void benchRemoveDir(const char* dir, size_t entries)
+{
+    char path[PATH_MAX];
+    for (size_t i = 0; i < entries; i++)
+    {
+        snprintf(path, sizeof(path), "%s/file%07zu", dir, i);
+        unlink(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/unique_target", dir);
+    rmdir(path);
+    rmdir(dir);
+}
+
+static double benchComplete(const char* dir, const char* partial)
+{
+    char* command = malloc(strlen(dir) + strlen(partial) + 8);
+    sprintf(command, "ls %s/%s", dir, partial);
+
+    double start = benchNow();
+    editorTabComplete(&command, true);
+    double elapsed = benchNow() - start;
+
+    free(command);
+    return elapsed;
+}
+
+/**
+ * Completes a unique name and an ambiguous prefix in directories of growing size.
+ * The first completion reads the directory, the rest are served by the dircache.
+ */
+static void benchTabComplete(const char* root)
+{
+    char* env = getenv("BOONE_BENCH_MAX_ENTRIES");
+    size_t max_entries = env != NULL ? strtoul(env, NULL, 10) : BENCH_MAX_ENTRIES;
+
+    for (size_t i = 0; i < sizeof(bench_dir_sizes) / sizeof(size_t) && bench_dir_sizes[i] <= max_entries; i++)
+    {
+        size_t entries = bench_dir_sizes[i];
+        char dir[PATH_MAX];
+        snprintf(dir, sizeof(dir), "%s/%zu", root, entries);
+
+        if (benchMakeDir(dir, entries) == -1)
+        {
+            benchRemoveDir(dir, entries);
+            return;
+        }
+
+        benchReport("complete (cold)", entries, 1, benchComplete(dir, "uni"));
+
+        long iterations = benchIterations(entries * 64);
+        double elapsed = 0;
+        for (long j = 0; j < iterations; j++)
+        {
+            elapsed += benchComplete(dir, "uni");
+        }
+        benchReport("complete unique", entries, iterations, elapsed);
+
+        elapsed = 0;
+        for (long j = 0; j < iterations; j++)
+        {
+            elapsed += benchComplete(dir, "file");
+        }
+        benchReport("complete ambiguous", entries, iterations, elapsed);
+
+        benchRemoveDir(dir, entries);
+    }
+}
+
+int main(void)
+{
+    char root[] = "/tmp/boone-bench-XXXXXX";
+    if (mkdtemp(root) == NULL)
+    {
+        perror("Could not create benchmark directory! ");
+        return 1;
+    }
+
+    printf("%-22s %10s %10s %17s\n", "benchmark", "size", "iterations", "time");
+    benchTokenizers();
+    benchInsertDelete();
+    benchLongLine(root);
+    benchTabComplete(root);
+
+    rmdir(root);
+    return 0;
+}
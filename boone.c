@@ -1,18 +1,42 @@
 #include "boone.h"
+#include <inttypes.h>
 
 pid_t child_pid = NO_CHILD_PID;
 bool is_suspended = false;
-int process_ids[1024];
-int process_idx = 0;
 char program_wd[256] = "";
+int spawn_stdin = -1;
+int spawn_stdout = -1;
+int spawn_stderr = -1;
 
-char* shell_commands[] = {"exit", "cd", "history", "fg"};
+// The command line being run and its history record, so its run statistics can be filled in once it finishes.
+static char* command_line = NULL;
+static uint64_t command_seq = 0;
+
+// Whether the command line ended with &.
+static bool command_background = false;
+
+struct history_duration
+{
+    uint64_t seq;
+    uint64_t duration_us;
+};
+
+char* shell_commands[] = {"exit", "cd", "history", "fg", "parallel", "on", "timeout", "watchdog", "load", "unload", "j", "export", "unset"};
 
 int (*shell_functions[]) (char **) = {
     &shell_exit,
     &shell_cd,
     &shell_history,
-    &shell_fg
+    &shell_fg,
+    &shell_parallel,
+    &shell_on,
+    &shell_timeout,
+    &shell_watchdog,
+    &shell_load,
+    &shell_unload,
+    &shell_j,
+    &shell_export,
+    &shell_unset
 };
 
 int shell_exit(char** args)
@@ -25,7 +49,7 @@ int shell_exit(char** args)
     sprintf(cursor, "\x1b[%d;1H", editor_state.y);
     printf("%s\n", cursor);
 
-    return 1;
+    return BOONE_BUILTIN_EXIT;
 }
 
 int shell_cd(char **args)
@@ -33,49 +57,336 @@ int shell_cd(char **args)
     if (args[1] == NULL) 
     {
         perror("No argument provided! ");
+        return 1;
     } 
     else
     {
         if (chdir(args[1]) != 0)
         {
             perror("Could not change directory! ");
+            return 1;
+        }
+        else
+        {
+            promptChangedDirectory();
+            jumpVisit(prompt_state.cwd);
+
+            // Warm the completion cache so the first tab in the new directory doesn't pay for readdir.
+            dircachePrefetch(prompt_state.cwd, VARS_GET("BOONE_PREFETCH_SUBDIRS") != NULL);
         }
     }
 
-    editor_state.cwd = getcwd(NULL, 0);
     return 0;
 }
 
-int shell_history(char** args)
+// Writes the buffered history listing to the terminal in one go.
+static void history_flush(struct boone_output* out)
+{
+    size_t written = 0;
+    while (written < out->len)
+    {
+        ssize_t n = write(STDOUT_FILENO, out->data + written, out->len - written);
+        if (n == -1 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        written += n;
+    }
+    out->len = 0;
+}
+
+// Appends one record to out, only writing once a whole chunk of them has built up.
+static void history_emit(struct boone_output* out, uint64_t seq, const char* line, size_t len,
+                         const struct history_stats* stats)
+{
+    char prefix[96];
+    int prefix_len;
+    if (stats == NULL)
+    {
+        prefix_len = snprintf(prefix, sizeof(prefix), "\r%" PRIu64 " ", seq);
+    }
+    else
+    {
+        prefix_len = snprintf(prefix, sizeof(prefix), "\r%" PRIu64 " %9.3fs %9.3fs %3d ", seq,
+                              stats->duration_us / 1e6, stats->cpu_us / 1e6, stats->status);
+    }
+
+    outputWrite(out, prefix, prefix_len);
+    outputWrite(out, line, len);
+    outputWrite(out, "\n", 1);
+
+    if (out->len >= HISTORY_WRITE_CHUNK)
+    {
+        history_flush(out);
+    }
+}
+
+static int compare_durations(const void* a, const void* b)
+{
+    const struct history_duration* left = a;
+    const struct history_duration* right = b;
+    return (left->duration_us < right->duration_us) - (left->duration_us > right->duration_us);
+}
+
+// Lists the n finished commands that took the longest, slowest first.
+static void history_slowest(struct boone_output* out, size_t n)
 {
-    FILE* file = fopen(program_wd, "r");
-    if (file == NULL)
+    uint64_t first = historyFirst();
+    uint64_t count = historyCount();
+    struct history_duration* durations = malloc((count - first) * sizeof(struct history_duration));
+    size_t found = 0;
+    size_t cap = 0;
+    char* line = NULL;
+    struct history_stats stats;
+
+    if (durations == NULL && count > first)
     {
-        perror("Could not open history file! ");
+        perror("Could not allocate! ");
+        return;
     }
 
-    int line_num = 0;
-    char line[256];
+    for (uint64_t seq = first; seq < count; seq++)
+    {
+        if (historyGet(seq, &line, &cap, &stats) != -1 && stats.status != -1)
+        {
+            durations[found].seq = seq;
+            durations[found].duration_us = stats.duration_us;
+            found++;
+        }
+    }
+
+    qsort(durations, found, sizeof(struct history_duration), compare_durations);
+    for (size_t i = 0; i < found && i < n; i++)
+    {
+        ssize_t len = historyGet(durations[i].seq, &line, &cap, &stats);
+        if (len != -1)
+        {
+            history_emit(out, durations[i].seq, line, len, &stats);
+        }
+    }
+
+    free(durations);
+    free(line);
+}
 
-    while (fgets(line, sizeof(line), file)) 
+static void history_failed(struct boone_output* out)
+{
+    size_t cap = 0;
+    char* line = NULL;
+    struct history_stats stats;
+    uint64_t count = historyCount();
+
+    for (uint64_t seq = historyFirst(); seq < count; seq++)
     {
-        printf("\r%d %s",  line_num, line); 
-        line_num++;
+        ssize_t len = historyGet(seq, &line, &cap, &stats);
+        if (len != -1 && stats.status > 0)
+        {
+            history_emit(out, seq, line, len, &stats);
+        }
+    }
+
+    free(line);
+}
+
+/**
+ * Finds where the last n live records start by walking back from the newest one,
+ * so only those records are ever read no matter how long the history is.
+ */
+static uint64_t history_tail_start(uint64_t first, uint64_t count, long n)
+{
+    size_t cap = 0;
+    char* line = NULL;
+    uint64_t start = count;
+
+    while (start > first && n > 0)
+    {
+        start--;
+        if (historyGet(start, &line, &cap, NULL) != -1)
+        {
+            n--;
+        }
+    }
+
+    free(line);
+    return start;
+}
+
+// Parses N for the last N records or A..B for a range, where either end of the range may be left out.
+static bool history_parse_range(const char* arg, uint64_t* from, uint64_t* to)
+{
+    uint64_t first = *from;
+    uint64_t count = *to;
+    const char* dots = strstr(arg, "..");
+    char* end;
+
+    if (dots == NULL)
+    {
+        long n = strtol(arg, &end, 10);
+        if (end == arg || *end != '\0' || n < 0)
+        {
+            return false;
+        }
+        *from = history_tail_start(first, count, n);
+        return true;
+    }
+
+    if (dots != arg)
+    {
+        *from = strtoull(arg, &end, 10);
+        if (end != dots)
+        {
+            return false;
+        }
+    }
+    if (dots[2] != '\0')
+    {
+        *to = strtoull(dots + 2, &end, 10) + 1;
+        if (*end != '\0')
+        {
+            return false;
+        }
+    }
+
+    *from = *from < first ? first : *from;
+    *to = *to > count ? count : *to;
+    return true;
+}
+
+int shell_history(char** args)
+{
+    struct boone_output out;
+    memset(&out, 0, sizeof(out));
+
+    // Anything printf still holds has to go out before our own writes.
+    fflush(stdout);
+
+    if (args[1] != NULL && strcmp(args[1], "--slowest") == 0)
+    {
+        char* end = NULL;
+        long n = args[2] != NULL ? strtol(args[2], &end, 10) : 10;
+        if (n <= 0 || (end != NULL && (end == args[2] || *end != '\0')))
+        {
+            printf("\r%s\n", "Usage: history [N | A..B | --slowest N | --failed]");
+            return 1;
+        }
+        history_slowest(&out, n);
+    }
+    else if (args[1] != NULL && strcmp(args[1], "--failed") == 0)
+    {
+        history_failed(&out);
+    }
+    else
+    {
+        uint64_t from = historyFirst();
+        uint64_t to = historyCount();
+        if (args[1] != NULL && !history_parse_range(args[1], &from, &to))
+        {
+            printf("\r%s\n", "Usage: history [N | A..B | --slowest N | --failed]");
+            return 1;
+        }
+
+        size_t cap = 0;
+        char* line = NULL;
+        for (uint64_t seq = from; seq < to; seq++)
+        {
+            ssize_t len = historyGet(seq, &line, &cap, NULL);
+            if (len != -1)
+            {
+                history_emit(&out, seq, line, len, NULL);
+            }
+        }
+        free(line);
     }
 
-    fclose(file);
-    printf("%s", "\n");
+    outputWrite(&out, "\n", 1);
+    history_flush(&out);
+    outputFree(&out);
 
     return 0;
 }
 
 int shell_fg(char** args)
 {
+    struct job* job = jobLastStopped();
+    if (job == NULL)
+    {
+        printf("\r%s\n", "No suspended programs!");
+        return 1;
+    }
+
     enableMonitorMode();
-    process_idx--;
-    child_pid = process_ids[process_idx];
+    child_pid = job->pid;
+    job->state = JOB_RUNNING;
+    job->background = false;
     kill(child_pid, SIGCONT);
-    printf("\r[%d] %s\n", process_idx, "Program Resumed!");
+    printf("\r[%d] %s\n", jobId(job), "Program Resumed!");
+    return 0;
+}
+
+int shell_on(char** args)
+{
+    bool set_default = args[1] != NULL && strcmp(args[1], "--default") == 0;
+    char** policy_args = args + 1 + set_default;
+
+    struct launch_policy policy;
+    int consumed = policyParse(&policy, policy_args);
+    if (consumed == -1)
+    {
+        return 1;
+    }
+
+    if (set_default)
+    {
+        background_policy = policy;
+        return 0;
+    }
+
+    char** command = policy_args + consumed;
+    if (command[0] == NULL)
+    {
+        printf("\r%s\n", "Usage: on [cpus=LIST] [nice=N] [mem=SIZE] [cpu=SECS] [files=N] [procs=N] -- command");
+        printf("\r%s\n", "       on --default [policy...]");
+        return 1;
+    }
+
+    // Builtins like parallel spawn their own children, so they need to see the policy too.
+    policy_override = &policy;
+    int result = execute_process(command);
+    policy_override = NULL;
+
+    return result;
+}
+
+static uint64_t elapsed_us(const struct timespec* start, const struct timespec* end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000LL + (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+// CPU time used by the shell and every child it has reaped so far.
+static uint64_t cpu_time_us(void)
+{
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+
+    return (self.ru_utime.tv_sec + self.ru_stime.tv_sec + children.ru_utime.tv_sec + children.ru_stime.tv_sec) * 1000000ULL +
+           self.ru_utime.tv_usec + self.ru_stime.tv_usec + children.ru_utime.tv_usec + children.ru_stime.tv_usec;
+}
+
+void record_job(struct job* job)
+{
+    if (job->history_seq == 0 || job->history_line == NULL)
+    {
+        return;
+    }
+
+    int status = WIFEXITED(job->status) ? WEXITSTATUS(job->status) : 128 + WTERMSIG(job->status);
+    struct history_stats stats = { 0, elapsed_us(&job->start, &job->end), job->cpu_us, status };
+    historyFinish(job->history_seq - 1, job->history_line, strlen(job->history_line), &stats);
 }
 
 size_t shell_commands_size(void) 
@@ -85,7 +396,6 @@ size_t shell_commands_size(void)
 
 char** read_user_line(void)
 {
-    FILE* fd;
     int user_arg_size = USER_ARG_SIZE;
 
     char* line = malloc(1); 
@@ -93,36 +403,47 @@ char** read_user_line(void)
     strcpy(line, "");
     strcpy(editor_state.tab_command, "");
 
-    editor_state.cwd = getcwd(NULL, 0);
-    int len = strlen(editor_state.cwd) + strlen(PROMPT);
-
     // Initialize command line state
-    editor_state.x = len + 1;
-    editor_state.cwd_str_len = len + 1;
+    promptRefresh();
+    editor_state.x = editor_state.cwd_str_len;
     
     bool enter_pressed = false;
     do
     {
-        int status;
-        if (child_pid == NO_CHILD_PID || waitpid(child_pid, &status, WNOHANG) != 0 || is_suspended)
+        // The foreground job is reaped by the event loop, which wakes us up when it changes state.
+        struct job* job = child_pid != NO_CHILD_PID ? jobFind(child_pid) : NULL;
+
+        if (job == NULL || job->state != JOB_RUNNING || is_suspended)
         {
             enableRawMode();
 
-            if ( child_pid != NO_CHILD_PID && WIFEXITED(status) )
+            if (job != NULL && job->state == JOB_DONE)
             {
-                int code = WEXITSTATUS(status);
-                status = -1;
-                printf("Exited with status code: %d\n", code);
+                if (WIFEXITED(job->status))
+                {
+                    printf("Exited with status code: %d\n", WEXITSTATUS(job->status));
+                    promptSetStatus(WEXITSTATUS(job->status));
+                }
+
+                if (WIFSIGNALED(job->status))
+                {
+                    printf("Signaled with status code: %d\n", WTERMSIG(job->status));
+                    promptSetStatus(128 + WTERMSIG(job->status));
+                }
+
+                record_job(job);
+                jobFree(job);
+                child_pid = NO_CHILD_PID;
             }
 
-            if ( child_pid != NO_CHILD_PID && WIFSIGNALED(status) )
+            traceFlush(false);
+            backgroundCollect();
+
+            // Keys that are already waiting are handled before drawing, so a paste is drawn once.
+            if (!editorInputPending())
             {
-                int code = WTERMSIG(status);
-                status = -1;
-                printf("Signaled with status code: %d\n", code);
+                editorRefreshScreen(line);
             }
-
-            editorRefreshScreen(line);
             enter_pressed = editorProcessKeypress(&line, false);
         }
         else
@@ -133,13 +454,14 @@ char** read_user_line(void)
     }
     while(!enter_pressed);
 
-    char cursor[32];
-    sprintf(cursor, "\x1b[%d;1H", editor_state.y);
-    printf("%s\n", cursor);
+    // Part of a paste might not have been drawn yet. The completion hint goes, it wasn't accepted.
+    editor_state.tab_command[0] = '\0';
+    editorRefreshScreen(line);
+    editorEndLine();
 
     // If no arguments provided we just signal by returning NULL.
     bool has_args = false;
-    for (int i = 0; i < strlen(line); i++)
+    for (int i = 0; line[i] != '\0'; i++)
     {
         if (line[i] != ' ')
         {
@@ -149,30 +471,50 @@ char** read_user_line(void)
     }
     if (!has_args)
     {
+        free(line);
         return NULL;
     }
 
-    fd = fopen(program_wd, "a+");
-    if (fd == NULL)
+    free(command_line);
+    command_line = strdup(line);
+    command_seq = historyAppend(line, strlen(line));
+    editor_state.history_max = historyCount();
+    editor_state.history_pos = editor_state.history_max;
+    
+    // Expanding runs any $(...) in the line, the arguments don't point into it afterwards.
+    char** tokens = lexerExpand(line);
+    free(line);
+
+    command_background = tokens != NULL && backgroundRequested(tokens);
+    if (tokens != NULL && tokens[0] == NULL)
     {
-        perror("Could not open file! ");
+        free(tokens);
+        return NULL;
     }
+    return tokens;
+}
 
-    if (fprintf(fd, "\n%s", line) < 0)
+static bool is_builtin(const char* name)
+{
+    for (size_t i = 0; i < shell_commands_size(); i++)
     {
-        perror("Could not write to history! ");
+        if (strcmp(name, shell_commands[i]) == 0)
+        {
+            return true;
+        }
     }
-
-    editor_state.history_max++;
-    editor_state.history_pos = editor_state.history_max;
-    fclose(fd);
-    
-    char** tokens = editorGetArgs(line);
-    return tokens;
+    return pluginFind(name) != NULL;
 }
 
 int execute_process(char** user_args)
 {
+    // A line of nothing but NAME=value sets shell variables.
+    if (varsAssign(user_args))
+    {
+        child_pid = NO_CHILD_PID;
+        return 0;
+    }
+
     // First check if were trying to execute a shell command.
     for (size_t i = 0; i < shell_commands_size(); i++)
     {
@@ -187,75 +529,118 @@ int execute_process(char** user_args)
         }
     }
 
+    // Then builtins loaded from plugins, which run in process just the same.
+    boone_builtin plugin = pluginFind(user_args[0]);
+    if (plugin != NULL)
+    {
+        child_pid = NO_CHILD_PID;
+        return pluginRun(plugin, user_args);
+    }
+
     // Then just execute the command the user wants.
-    pid_t parent_pid;
-    int status;
+    struct job* job = spawn_process(user_args, NULL);
+    child_pid = job != NULL ? job->pid : NO_CHILD_PID;
 
-    child_pid = fork();
+    return job != NULL ? 0 : 1;
+}
+
+struct job* spawn_process(char** user_args, const struct launch_policy* policy)
+{
+    if (policy_override != NULL)
+    {
+        policy = policy_override;
+    }
+
+    traceEvent(TRACE_FORK_START, 0);
+    pid_t pid = fork();
 
-    switch(child_pid)
+    switch(pid)
     {
         case 0: 
-            if (execvp(user_args[0], user_args) < 1)
+            if (policy != NULL && policyApply(policy) == -1)
             {
-                perror("Error executing program! ");
-                return 1;
+                _exit(126);
             }
-            break;
+
+            if ((spawn_stdin != -1 && dup2(spawn_stdin, STDIN_FILENO) == -1) ||
+                (spawn_stdout != -1 && dup2(spawn_stdout, STDOUT_FILENO) == -1) ||
+                (spawn_stderr != -1 && dup2(spawn_stderr, STDERR_FILENO) == -1))
+            {
+                _exit(126);
+            }
+
+            // execvp searches the PATH in environ, so the exported one is used for that too.
+            environ = varsEnvironment();
+            execvp(user_args[0], user_args);
+            perror("Error executing program! ");
+
+            // Don't run the shell's exit handlers, they belong to the parent.
+            _exit(127);
 
         case -1:
             perror("Could not fork! ");
-            break;
+            return NULL;
     }
 
-    return 0;
+    traceEvent(TRACE_FORK_END, pid);
+
+    struct job* job = jobAdd(pid, user_args);
+    if (job == NULL)
+    {
+        fprintf(stderr, "Job table is full, killing %d!\n", pid);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+    }
+    return job;
 }
 
-int main(int argc, char** argv, char** envp)
+int execute_command_line(char** user_args)
 {
-    atexit(disableModes);
-
-    editor_state.y = 50;
-    tcgetattr(STDIN_FILENO, &orig_termios);
-    write(STDOUT_FILENO, "\x1b[2J", 4);
-    write(STDOUT_FILENO, "\x1b[H", 3);
-    getcwd(program_wd, sizeof(program_wd));
-    strcat(program_wd, "/history.txt");
-
-    FILE* fp = fopen(program_wd, "a+");
-    if (fp == NULL)
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t cpu_start = cpu_time_us();
+
+    // Builtins run inside the shell, so a trailing & only sends programs to the background.
+    int result = 0;
+    struct job* job = NULL;
+    if (command_background && !is_builtin(user_args[0]))
     {
-        perror("Could not create / open file history.txt at beginning! ");
-        return 1;
+        job = backgroundLaunch(user_args);
+        result = job != NULL ? 0 : 1;
     }
- 
-    // Get # history lines and set it in our editor.
-    char c;
-    editor_state.history_max = 0;
-    for (c = getc(fp); c != EOF; c = getc(fp))
+    else
     {
-        if (c == '\n')
-        {
-            editor_state.history_max++;
-        }
+        result = execute_process(user_args);
+        job = child_pid != NO_CHILD_PID ? jobFind(child_pid) : NULL;
     }
-    editor_state.history_max++;
-    editor_state.history_pos = editor_state.history_max - 1;
-    fclose(fp);
+    command_background = false;
+    free(user_args);
+
+    bool exiting = result == BOONE_BUILTIN_EXIT;
+    int status = exiting ? 0 : result;
 
-    while (true)
+    // Programs in the foreground set the status once they finish, everything else has its status now.
+    if (job == NULL || job->background)
     {
-        char** user_args = read_user_line();
+        promptSetStatus(status);
+    }
 
-        if (user_args != NULL)
-        {
-            if (execute_process(user_args) == 1)
-            {
-                return 1;
-            }
-            free(user_args);
-        }
+    /**
+     * A program is recorded once it's reaped. Builtins are done by now, so they are
+     * recorded right away, counting the children they waited for as their cpu time.
+     * That includes fg, the job it resumes finishes the record of the line that started it.
+     */
+    if (job != NULL && job->history_seq == 0 && command_line != NULL)
+    {
+        job->history_seq = command_seq + 1;
+        job->history_line = strdup(command_line);
+    }
+    else if (command_line != NULL)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        struct history_stats stats = { 0, elapsed_us(&start, &end), cpu_time_us() - cpu_start, status };
+        historyFinish(command_seq, command_line, strlen(command_line), &stats);
     }
 
-    return 0;
-}
\ No newline at end of file
+    return exiting ? 1 : 0;
+}
@@ -12,21 +12,48 @@
 #include <fcntl.h>
 #include <ctype.h>
 #include <dirent.h>
+#include "background.h"
+#include "dircache.h"
 #include "editor.h"
+#include "history.h"
+#include "jobs.h"
+#include "jump.h"
+#include "lexer.h"
+#include "plugin.h"
+#include "policy.h"
+#include "event.h"
+#include "hash.h"
+#include "prompt.h"
+#include "trace.h"
+#include "vars.h"
 
 #define NO_CHILD_PID -100
 
+// The history builtin writes its listing in chunks of at least this many bytes.
+#define HISTORY_WRITE_CHUNK 65536
+
 extern pid_t child_pid;
+extern char* shell_commands[];
 extern bool is_suspended;
-extern int process_ids[1024];
-extern int process_idx;
 extern char program_wd[256];
 
+/**
+ * While not -1, everything spawned gets these as its standard input, output and error.
+ * Used to capture $(...) and to keep background jobs off the terminal.
+ */
+extern int spawn_stdin;
+extern int spawn_stdout;
+extern int spawn_stderr;
+
 // Shell builtin commands.
 int shell_exit(char** args);
 int shell_cd(char **args);
 int shell_history(char** args);
 int shell_fg(char** args);
+int shell_parallel(char** args);
+int shell_on(char** args);
+int shell_timeout(char** args);
+int shell_watchdog(char** args);
 
 // Returns size of the shell command array.
 size_t shell_commands_size(void);
@@ -37,4 +64,19 @@ char** read_user_line(void);
 // Executes the process supplied by the user arguments.
 int execute_process(char** user_args);
 
+/**
+ * Executes a line returned by read_user_line, freeing it, and records how it ran in history.
+ * Returns 1 once the exit builtin ran.
+ */
+int execute_command_line(char** user_args);
+
+/**
+ * Forks and execs the user arguments under the given launch policy, which may be NULL,
+ * adding the child to the job table. Returns NULL if it couldn't.
+ */
+struct job* spawn_process(char** user_args, const struct launch_policy* policy);
+
+// Fills in the history record of the command line that started the job, now that it's done.
+void record_job(struct job* job);
+
 #endif
@@ -0,0 +1,329 @@
+#include "dircache.h"
+#include "worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+struct dircache_prefetch
+{
+    char* path;
+    bool subdirectories;
+};
+
+/**
+ * Listings are shared between the main thread, which completes against them,
+ * and the worker thread, which prefetches them. Both go through the lock and
+ * keep a listing alive with a reference while they use it.
+ */
+static struct dircache_listing* dircache[DIRCACHE_MAX];
+static pthread_mutex_t dircache_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long dircache_clock = 0;
+
+// Drops "." components, repeated and trailing slashes so every spelling of a directory shares one entry.
+static void dircacheKey(const char* directory, char* key, size_t size)
+{
+    size_t len = 0;
+    const char* p = directory;
+
+    while (*p != '\0' && len + 2 < size)
+    {
+        if (*p == '/')
+        {
+            while (*p == '/' || (p[0] == '.' && (p[1] == '/' || p[1] == '\0') && p[-1] == '/'))
+            {
+                p++;
+            }
+            key[len++] = '/';
+            continue;
+        }
+        key[len++] = *p++;
+    }
+
+    if (len > 1 && key[len - 1] == '/')
+    {
+        len--;
+    }
+    key[len] = '\0';
+}
+
+static void dircacheFree(struct dircache_listing* listing)
+{
+    free(listing->path);
+    free(listing->names);
+    free(listing->types);
+    free(listing);
+}
+
+static struct dircache_listing* dircacheRead(const char* path, const struct stat* st)
+{
+    DIR* d = opendir(path);
+    if (d == NULL)
+    {
+        return NULL;
+    }
+
+    struct dircache_listing* listing = calloc(1, sizeof(struct dircache_listing));
+    size_t names_size = 0;
+    size_t names_cap = 4096;
+    char* names = malloc(names_cap);
+    int cap = 64;
+    size_t* offsets = malloc(cap * sizeof(size_t));
+    unsigned char* types = malloc(cap);
+
+    if (listing == NULL || names == NULL || offsets == NULL || types == NULL)
+    {
+        goto fail;
+    }
+
+    // Names are packed into one block behind the pointer array, so a listing is two allocations.
+    struct dirent* dir;
+    while ((dir = readdir(d)) != NULL)
+    {
+        size_t len = strlen(dir->d_name) + 1;
+        if (names_size + len > names_cap)
+        {
+            names_cap = names_cap * 2 + len;
+            char* grown = realloc(names, names_cap);
+            if (grown == NULL)
+            {
+                goto fail;
+            }
+            names = grown;
+        }
+        if (listing->count + 1 >= cap)
+        {
+            cap *= 2;
+            size_t* grown_offsets = realloc(offsets, cap * sizeof(size_t));
+            unsigned char* grown_types = realloc(types, cap);
+            offsets = grown_offsets != NULL ? grown_offsets : offsets;
+            types = grown_types != NULL ? grown_types : types;
+            if (grown_offsets == NULL || grown_types == NULL)
+            {
+                goto fail;
+            }
+        }
+
+        unsigned char type = dir->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK)
+        {
+            // Follow links so completion treats a link to a directory like a directory.
+            struct stat entry_st;
+            if (fstatat(dirfd(d), dir->d_name, &entry_st, 0) == 0)
+            {
+                type = S_ISDIR(entry_st.st_mode) ? DT_DIR : DT_REG;
+            }
+        }
+
+        memcpy(names + names_size, dir->d_name, len);
+        offsets[listing->count] = names_size;
+        types[listing->count] = type;
+        names_size += len;
+        listing->count++;
+    }
+    closedir(d);
+    d = NULL;
+
+    size_t pointers_size = (listing->count + 1) * sizeof(char*);
+    listing->names = malloc(pointers_size + names_size);
+    if (listing->names == NULL)
+    {
+        goto fail;
+    }
+
+    char* packed = (char*) listing->names + pointers_size;
+    memcpy(packed, names, names_size);
+    for (int i = 0; i < listing->count; i++)
+    {
+        listing->names[i] = packed + offsets[i];
+    }
+    listing->names[listing->count] = NULL;
+
+    listing->types = types;
+    listing->path = strdup(path);
+    listing->mtime = st->st_mtim;
+    listing->refs = 1;
+
+    free(names);
+    free(offsets);
+    return listing;
+
+fail:
+    if (d != NULL)
+    {
+        closedir(d);
+    }
+    if (listing != NULL)
+    {
+        free(listing->names);
+        free(listing);
+    }
+    free(names);
+    free(offsets);
+    free(types);
+    return NULL;
+}
+
+// Must hold dircache_lock. Returns the index of path in the cache, or -1.
+static int dircacheFind(const char* path)
+{
+    for (int i = 0; i < DIRCACHE_MAX; i++)
+    {
+        if (dircache[i] != NULL && strcmp(dircache[i]->path, path) == 0)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Must hold dircache_lock. Drops the cache's reference to the listing at index i.
+static void dircacheDrop(int i)
+{
+    if (--dircache[i]->refs == 0)
+    {
+        dircacheFree(dircache[i]);
+    }
+    dircache[i] = NULL;
+}
+
+// Must hold dircache_lock. Stores a listing, replacing a stale copy or evicting the least recently used one.
+static void dircacheInsert(struct dircache_listing* listing)
+{
+    int slot = dircacheFind(listing->path);
+    if (slot == -1)
+    {
+        slot = 0;
+        for (int i = 0; i < DIRCACHE_MAX; i++)
+        {
+            if (dircache[i] == NULL)
+            {
+                slot = i;
+                break;
+            }
+            if (dircache[i]->used < dircache[slot]->used)
+            {
+                slot = i;
+            }
+        }
+    }
+
+    if (dircache[slot] != NULL)
+    {
+        dircacheDrop(slot);
+    }
+
+    listing->refs++;
+    listing->used = ++dircache_clock;
+    dircache[slot] = listing;
+}
+
+struct dircache_listing* dircacheGet(const char* directory)
+{
+    char path[PATH_MAX];
+    dircacheKey(directory, path, sizeof(path));
+
+    struct stat st;
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+    {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&dircache_lock);
+    int i = dircacheFind(path);
+    if (i != -1)
+    {
+        struct dircache_listing* listing = dircache[i];
+        if (listing->mtime.tv_sec == st.st_mtim.tv_sec && listing->mtime.tv_nsec == st.st_mtim.tv_nsec)
+        {
+            listing->refs++;
+            listing->used = ++dircache_clock;
+            pthread_mutex_unlock(&dircache_lock);
+            return listing;
+        }
+    }
+    pthread_mutex_unlock(&dircache_lock);
+
+    // Cold or changed, read it ourselves.
+    struct dircache_listing* listing = dircacheRead(path, &st);
+    if (listing != NULL)
+    {
+        pthread_mutex_lock(&dircache_lock);
+        dircacheInsert(listing);
+        pthread_mutex_unlock(&dircache_lock);
+    }
+
+    return listing;
+}
+
+void dircacheRelease(struct dircache_listing* listing)
+{
+    if (listing == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&dircache_lock);
+    if (--listing->refs == 0)
+    {
+        dircacheFree(listing);
+    }
+    pthread_mutex_unlock(&dircache_lock);
+}
+
+static void dircachePrefetchJob(void* arg)
+{
+    struct dircache_prefetch* prefetch = arg;
+    struct dircache_listing* listing = dircacheGet(prefetch->path);
+
+    if (listing != NULL && prefetch->subdirectories)
+    {
+        int fetched = 0;
+        char subdirectory[PATH_MAX];
+
+        for (int i = 0; i < listing->count && fetched < DIRCACHE_PREFETCH_SUBDIRS; i++)
+        {
+            if (listing->types[i] != DT_DIR || strcmp(listing->names[i], ".") == 0 ||
+                strcmp(listing->names[i], "..") == 0)
+            {
+                continue;
+            }
+
+            snprintf(subdirectory, sizeof(subdirectory), "%s/%s", listing->path, listing->names[i]);
+            dircacheRelease(dircacheGet(subdirectory));
+            fetched++;
+        }
+    }
+
+    dircacheRelease(listing);
+    free(prefetch->path);
+    free(prefetch);
+}
+
+void dircachePrefetch(const char* directory, bool subdirectories)
+{
+    struct dircache_prefetch* prefetch = malloc(sizeof(struct dircache_prefetch));
+    if (prefetch == NULL)
+    {
+        return;
+    }
+
+    prefetch->path = strdup(directory);
+    prefetch->subdirectories = subdirectories;
+    if (prefetch->path == NULL)
+    {
+        free(prefetch);
+        return;
+    }
+
+    if (workerSubmit(dircachePrefetchJob, prefetch) == -1)
+    {
+        free(prefetch->path);
+        free(prefetch);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef DIRCACHE_H
+#define DIRCACHE_H
+
+#include <stdbool.h>
+#include <time.h>
+
+// Most directory listings kept around for completion.
+#define DIRCACHE_MAX 256
+
+// Most subdirectories prefetched after a cd.
+#define DIRCACHE_PREFETCH_SUBDIRS 64
+
+struct dircache_listing
+{
+    char* path;
+    struct timespec mtime;
+    int count;
+
+    // File names and their d_type values, NULL terminated.
+    char** names;
+    unsigned char* types;
+
+    int refs;
+    unsigned long used;
+};
+
+/**
+ * Returns the listing of an absolute directory path, reading it only if it
+ * isn't cached or its mtime changed since. Returns NULL if it can't be read.
+ * Release the listing with dircacheRelease once done with it.
+ */
+struct dircache_listing* dircacheGet(const char* directory);
+void dircacheRelease(struct dircache_listing* listing);
+
+// Reads a directory into the cache on the worker thread, optionally along with its subdirectories.
+void dircachePrefetch(const char* directory, bool subdirectories);
+
+#endif
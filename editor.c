@@ -1,5 +1,8 @@
 #include "editor.h"
 
+#include <poll.h>
+#include <sys/ioctl.h>
+
 struct termios orig_termios;
 struct state editor_state;
 bool first_prompt = true;
@@ -12,7 +15,8 @@ void enableRawMode(void)
     raw.c_cflag |= (CS8);
     raw.c_lflag &= ~(ECHO | ICANON | ISIG | IEXTEN);
 
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
+    // This runs before every keypress, so it mustn't flush typeahead, or the rest of a paste is lost.
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
     {
         perror("Could not enable raw mode! ");
         exit(1);
@@ -24,7 +28,7 @@ void enableMonitorMode(void)
     struct termios raw = orig_termios;
     raw.c_lflag &= ~(ISIG | ICANON | ECHO);
 
-    if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
     {
         perror("Could not enable monitor mode! ");
         exit(1);
@@ -40,43 +44,372 @@ void disableModes(void)
     }
 }
 
-void editorRefreshScreen(char* command) 
+// Part of the edit area drawn in its own color.
+struct editor_piece
+{
+    const char* color;
+    const char* text;
+    size_t len;
+};
+
+/**
+ * What the last refresh left on screen. The edit area sits on the bottom rows,
+ * and the next refresh only redraws from the first row whose text changed.
+ */
+struct editor_render
+{
+    bool valid;
+    char* text;
+    size_t len;
+    size_t cap;
+    size_t piece_ends[EDITOR_PIECES];
+    int cols;
+    int visible_rows;
+    size_t top_row;
+
+    // Screen row and column the cursor was left on.
+    int cursor_row;
+    int cursor_col;
+};
+
+static struct editor_render render;
+static struct boone_output screen;
+
+// SIGWINCH writes a byte to this pipe, which wakes the event loop up to read the new size.
+static int window_pipe[2] = { -1, -1 };
+
+static void editorReadWindowSize(void)
+{
+    struct winsize size;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 || size.ws_row == 0 || size.ws_col == 0)
+    {
+        editor_state.rows = EDITOR_DEFAULT_ROWS;
+        editor_state.cols = EDITOR_DEFAULT_COLS;
+        return;
+    }
+
+    editor_state.rows = size.ws_row;
+    editor_state.cols = size.ws_col;
+}
+
+static void editorWindowSignal(int sig)
+{
+    int saved_errno = errno;
+    write(window_pipe[1], "", 1);
+    errno = saved_errno;
+}
+
+static void editorWindowChanged(int fd, void* data)
+{
+    char drain[64];
+    while (read(fd, drain, sizeof(drain)) > 0);
+
+    // The terminal reflowed whatever we drew, so start over on the bottom rows.
+    editorReadWindowSize();
+    render.valid = false;
+    eventRequestRefresh();
+}
+
+void editorInitWindow(void)
+{
+    editorReadWindowSize();
+
+    if (pipe2(window_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        perror("Could not create window signal pipe! ");
+        return;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = editorWindowSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGWINCH, &action, NULL) == -1)
+    {
+        perror("Could not handle SIGWINCH! ");
+        return;
+    }
+
+    eventAdd(window_pipe[0], editorWindowChanged, NULL);
+}
+
+void editorEndLine(void)
+{
+    // Leave the cursor below the last row of the edit area, where the program's output goes.
+    char move[32];
+    int len = snprintf(move, sizeof(move), "\x1b[%d;1H\r\n", editor_state.rows);
+    write(STDOUT_FILENO, move, len);
+
+    render.valid = false;
+}
+
+// Moves the cursor from the screen row it is on to column col of row, without absolute addressing.
+static void editorMoveTo(struct boone_output* out, int from_row, int row, int col)
+{
+    outputWrite(out, "\r", 1);
+    if (row < from_row)
+    {
+        outputPrintf(out, "\x1b[%dA", from_row - row);
+    }
+    else if (row > from_row)
+    {
+        outputPrintf(out, "\x1b[%dB", row - from_row);
+    }
+    if (col > 0)
+    {
+        outputPrintf(out, "\x1b[%dC", col);
+    }
+}
+
+void editorPrintAbove(struct boone_output* out, const char* text, size_t len)
+{
+    const char* end = text + len;
+
+    if (!render.valid || editor_state.y <= 1)
+    {
+        // With no room above the edit area it's cleared, the next refresh draws it again below the text.
+        if (render.valid)
+        {
+            editorMoveTo(out, render.cursor_row, editor_state.y, 0);
+            outputWrite(out, "\x1b[J", 3);
+            render.valid = false;
+        }
+
+        for (const char* line = text; line < end; )
+        {
+            const char* newline = memchr(line, '\n', end - line);
+            const char* line_end = newline != NULL ? newline : end;
+            outputWrite(out, line, line_end - line);
+            outputWrite(out, "\r\n", 2);
+            line = line_end + 1;
+        }
+        return;
+    }
+
+    // Scrolling only the rows above the edit area leaves the prompt and the command being typed where they are.
+    outputPrintf(out, "\x1b[1;%dr\x1b[%d;1H", editor_state.y - 1, editor_state.y - 1);
+    for (const char* line = text; line < end; )
+    {
+        const char* newline = memchr(line, '\n', end - line);
+        const char* line_end = newline != NULL ? newline : end;
+        outputWrite(out, "\r\n", 2);
+        outputWrite(out, line, line_end - line);
+        line = line_end + 1;
+    }
+    outputPrintf(out, "\x1b[r\x1b[%d;%dH", render.cursor_row, render.cursor_col + 1);
+}
+
+// Returns the index of the first character that differs from what the last refresh drew.
+static size_t editorFirstChange(const struct editor_piece* pieces, const size_t* ends, size_t total)
+{
+    size_t change = total < render.len ? total : render.len;
+
+    // A color boundary that moved counts as a change too.
+    for (int i = 0; i < EDITOR_PIECES; i++)
+    {
+        if (ends[i] != render.piece_ends[i])
+        {
+            size_t moved = ends[i] < render.piece_ends[i] ? ends[i] : render.piece_ends[i];
+            change = moved < change ? moved : change;
+            break;
+        }
+    }
+
+    size_t start = 0;
+    for (int i = 0; i < EDITOR_PIECES && start < change; i++)
+    {
+        size_t len = pieces[i].len < change - start ? pieces[i].len : change - start;
+        if (memcmp(pieces[i].text, render.text + start, len) != 0)
+        {
+            size_t j = 0;
+            while (pieces[i].text[j] == render.text[start + j])
+            {
+                j++;
+            }
+            return start + j;
+        }
+        start += pieces[i].len;
+    }
+
+    return change;
+}
+
+// Writes the characters from index from up to end, switching colors at piece boundaries.
+static void editorWritePieces(struct boone_output* out, const struct editor_piece* pieces, size_t from, size_t end)
+{
+    size_t start = 0;
+    for (int i = 0; i < EDITOR_PIECES; i++)
+    {
+        size_t piece_end = start + pieces[i].len;
+        if (piece_end > from && start < end)
+        {
+            size_t first = from > start ? from - start : 0;
+            size_t last = (end < piece_end ? end : piece_end) - start;
+            outputWrite(out, pieces[i].color, strlen(pieces[i].color));
+            outputWrite(out, pieces[i].text + first, last - first);
+        }
+        start = piece_end;
+    }
+    outputWrite(out, "\x1b[0m", 4);
+}
+
+static void editorSaveRender(const struct editor_piece* pieces, const size_t* ends, size_t total)
+{
+    if (render.cap < total + 1)
+    {
+        char* grown = realloc(render.text, total + 1);
+        if (grown == NULL)
+        {
+            render.valid = false;
+            return;
+        }
+        render.text = grown;
+        render.cap = total + 1;
+    }
+
+    size_t start = 0;
+    for (int i = 0; i < EDITOR_PIECES; i++)
+    {
+        memcpy(render.text + start, pieces[i].text, pieces[i].len);
+        start += pieces[i].len;
+        render.piece_ends[i] = ends[i];
+    }
+    render.len = total;
+    render.valid = true;
+}
+
+void editorRefreshScreen(char* command)
 {
-    // Set cursor in the correct Y position
-    char cursor[32];
-    sprintf(cursor, "\x1b[%d;1H", editor_state.y);
+    traceEvent(TRACE_REFRESH_START, 0);
+    screen.len = 0;
 
-    // Write the CWD, prompt characters, and user command.
-    write(STDOUT_FILENO, cursor, 8);
+    if (editor_state.rows <= 0 || editor_state.cols <= 0)
+    {
+        editorReadWindowSize();
+    }
+    int rows = editor_state.rows;
+    int cols = editor_state.cols;
 
     if (first_prompt)
     {
         first_prompt = false;
+        outputPrintf(&screen, "\x1b[%d;1H", rows);
+        write(STDOUT_FILENO, screen.data, screen.len);
         write(STDERR_FILENO, "A simple shell written by Jarrod Boone!\n\r", 41);
+        screen.len = 0;
+    }
+
+    // The completion is drawn dimmed past the end of the command when it extends it.
+    size_t command_len = strlen(command);
+    size_t tab_len = strlen(editor_state.tab_command);
+    size_t ghost_len = 0;
+    if (tab_len > command_len && strncmp(editor_state.tab_command, command, command_len) == 0)
+    {
+        ghost_len = tab_len - command_len;
+    }
+
+    struct editor_piece pieces[EDITOR_PIECES] = {
+        { "\x1b[36m", prompt_state.cwd, prompt_state.cwd_len },
+        { "\x1b[33m", prompt_state.segments, prompt_state.segments_len },
+        { "\x1b[32m", PROMPT, strlen(PROMPT) },
+        { "\x1b[0m", command, command_len },
+        { "\x1b[0;36;2m", editor_state.tab_command + command_len, ghost_len }
+    };
+
+    size_t ends[EDITOR_PIECES];
+    size_t total = 0;
+    for (int i = 0; i < EDITOR_PIECES; i++)
+    {
+        total += pieces[i].len;
+        ends[i] = total;
+    }
+
+    // Long commands soft wrap. One past the last character still needs a row for the cursor.
+    size_t cursor = editor_state.x > 0 ? editor_state.x - 1 : 0;
+    size_t content_rows = total / cols + 1;
+    size_t cursor_row = cursor / cols;
+    int visible = content_rows < rows ? content_rows : rows;
+
+    // Commands taller than the screen are shown through a window that follows the cursor.
+    size_t top = render.valid ? render.top_row : 0;
+    if (content_rows <= rows)
+    {
+        top = 0;
+    }
+    else
+    {
+        top = cursor_row < top ? cursor_row : top;
+        top = cursor_row >= top + visible ? cursor_row - visible + 1 : top;
+        top = top + visible > content_rows ? content_rows - visible : top;
     }
 
-    // Set CWD to cyan.
-    write(STDOUT_FILENO, "\x1b[36m", 5);
-    write(STDOUT_FILENO, editor_state.cwd, strlen(editor_state.cwd));
+    size_t first_row = top;
+    if (!render.valid)
+    {
+        // A new prompt starts out on the bottom row.
+        outputPrintf(&screen, "\x1b[%d;1H", rows);
+        render.cursor_row = rows;
+        render.visible_rows = 1;
+    }
+    else if (render.cols == cols && render.top_row == top)
+    {
+        size_t change = editorFirstChange(pieces, ends, total);
+        if (change == total && total == render.len)
+        {
+            first_row = content_rows;
+        }
+        else if (change / cols > top)
+        {
+            first_row = change / cols;
+        }
+    }
 
-    // Set " ; " character to green.
-    write(STDOUT_FILENO, "\x1b[32m", 5);
-    write(STDOUT_FILENO, PROMPT, strlen(PROMPT));
+    /**
+     * Growing the edit area scrolls everything above it up, along with the rows we already
+     * drew, so they don't need drawing again. It never shrinks back while the same command
+     * is being edited, the scrollback wouldn't come back down with it.
+     *
+     * This scrolls the whole screen rather than a scroll region. A region above the edit
+     * area would leave the rows we drew where they are, so all of them would need drawing
+     * again a line higher, and terminals only keep what scrolls off a full screen region in
+     * their scrollback. editorPrintAbove uses one because the edit area has to stay put.
+     */
+    int area = visible > render.visible_rows ? visible : render.visible_rows;
+    if (area > render.visible_rows)
+    {
+        outputPrintf(&screen, "\x1b[%dS", area - render.visible_rows);
+    }
+
+    int screen_top = rows - area + 1;
+    int cursor_at = render.cursor_row;
+
+    if (first_row < top + visible)
+    {
+        size_t from = first_row * cols;
+        size_t end = (top + visible) * cols < total ? (top + visible) * cols : total;
+
+        int row = screen_top + (first_row - top);
+        editorMoveTo(&screen, cursor_at, row, 0);
+        outputWrite(&screen, "\x1b[J", 3);
+        editorWritePieces(&screen, pieces, from, end);
+
+        cursor_at = end > from ? screen_top + ((end - 1) / cols - top) : row;
+    }
 
-    // Print the auto-completed tab command.
-    write(STDOUT_FILENO, "\x1b[K", 3);
-    write(STDOUT_FILENO, "\x1b[36m", 5);
-    write(STDOUT_FILENO, "\x1b[2m", 4);
-    write(STDOUT_FILENO, editor_state.tab_command, strlen(editor_state.tab_command));
+    editorMoveTo(&screen, cursor_at, screen_top + (cursor_row - top), cursor % cols);
+    write(STDOUT_FILENO, screen.data, screen.len);
 
-    // Print the command.
-    write(STDOUT_FILENO, "\x1b[0m", 4);
-    sprintf(cursor, "\x1b[%d;%luH", editor_state.y, strlen(PROMPT) + strlen(editor_state.cwd) + 1);
-    write(STDOUT_FILENO, cursor, 8);
+    editorSaveRender(pieces, ends, total);
+    render.cols = cols;
+    render.top_row = top;
+    render.visible_rows = area;
+    render.cursor_row = screen_top + (cursor_row - top);
+    render.cursor_col = cursor % cols;
+    editor_state.y = screen_top;
 
-    write(STDOUT_FILENO, command, strlen(command));
-    sprintf(cursor, "\x1b[%d;%dH", editor_state.y, editor_state.x);
-    write(STDOUT_FILENO, cursor, 8);
+    traceEvent(TRACE_REFRESH_END, 0);
 }
 
 bool editorProcessKeypress(char** command, bool monitor_f)
@@ -90,17 +423,21 @@ bool editorProcessKeypress(char** command, bool monitor_f)
         {
             case CTRL_KEY('c'):
                 kill(child_pid, SIGKILL);
-                editor_state.y++;
                 break;
 
             case CTRL_KEY('z'):
+            {
                 kill(child_pid, SIGSTOP);
-                process_ids[process_idx] = child_pid;
-                child_pid = -100;
+                struct job* job = jobFind(child_pid);
+                child_pid = NO_CHILD_PID;
 
-                printf("[%d] %s\n", process_idx, "Program Suspended!");
-                process_idx++;
+                if (job != NULL)
+                {
+                    jobStop(job);
+                    printf("[%d] %s\n", jobId(job), "Program Suspended!");
+                }
                 break;
+            }
         }
     }
     else
@@ -112,7 +449,6 @@ bool editorProcessKeypress(char** command, bool monitor_f)
         switch (c)
         {
             case '\r':
-                editor_state.y++;
                 return true;
 
             case ARROW_LEFT:
@@ -121,11 +457,11 @@ bool editorProcessKeypress(char** command, bool monitor_f)
                 break;
 
             case ARROW_UP:
-                editorGetHistoryCommand(*command, ARROW_UP);
+                editorGetHistoryCommand(command, ARROW_UP);
                 break;
 
             case ARROW_DOWN:
-                editorGetHistoryCommand(*command, ARROW_DOWN);
+                editorGetHistoryCommand(command, ARROW_DOWN);
                 break;
 
             case DEL_K:
@@ -136,8 +472,11 @@ bool editorProcessKeypress(char** command, bool monitor_f)
                 editorDeleteCharacter(command, false);
                 break;
 
+            case REFRESH_K:
+                break;
+
             case CTRL_KEY('b'):
-                if (process_idx > 0)
+                if (jobLastStopped() != NULL)
                 {
                     shell_fg(NULL);
                     break;
@@ -145,7 +484,9 @@ bool editorProcessKeypress(char** command, bool monitor_f)
 
             case CTRL_KEY('i'):
             {
+                traceEvent(TRACE_COMPLETE_START, false);
                 editorTabComplete(command, false);
+                traceEvent(TRACE_COMPLETE_END, false);
                 break;
             }
 
@@ -153,78 +494,202 @@ bool editorProcessKeypress(char** command, bool monitor_f)
                 if (!iscntrl(c))
                 {
                     editorAddCharacter(command, c);
+
+                    // Pasted text is inserted a whole run at a time instead of a character at a time.
+                    const char* text;
+                    size_t len = editorTakeText(&text);
+                    if (len > 0)
+                    {
+                        editorInsertText(command, text, len);
+                    }
                 }
         }
     }
 
-    strcpy(editor_state.tab_command, *command);
+    // The completion hint is only drawn once the input is drained, so a paste doesn't compute one per chunk.
+    if (editorInputPending())
+    {
+        return false;
+    }
+
+    free(editor_state.tab_command);
+    editor_state.tab_command = strdup(*command);
+    traceEvent(TRACE_COMPLETE_START, true);
     editorTabComplete(&editor_state.tab_command, true);
+    traceEvent(TRACE_COMPLETE_END, true);
     return false;
 }
 
-int editorReadKey(void)
+// Bytes read from the terminal but not decoded yet. A paste arrives in chunks much bigger than one key.
+static char input[EDITOR_READ_CHUNK];
+static size_t input_pos;
+static size_t input_len;
+
+// Refills the input buffer. Returns false on EOF or timeout.
+static bool editorFillInput(void)
+{
+    ssize_t nread = read(STDIN_FILENO, input, sizeof(input));
+    if (nread == -1 && errno != EAGAIN && errno != EINTR)
+    {
+        perror("Could not read user input! ");
+        exit(1);
+    }
+
+    input_pos = 0;
+    input_len = nread > 0 ? nread : 0;
+    return input_len > 0;
+}
+
+bool editorInputPending(void)
 {
-    int nread = 0;
-    char c;
+    if (input_pos < input_len)
+    {
+        return true;
+    }
+
+    struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+    return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN);
+}
 
-    while (nread != 1)
+int editorBufferTypeahead(void)
+{
+    // Make room behind whatever is still waiting to be decoded.
+    memmove(input, input + input_pos, input_len - input_pos);
+    input_len -= input_pos;
+    input_pos = 0;
+
+    // Once the buffer is full the rest is only checked for Ctrl-C, so stdin doesn't stay readable forever.
+    char overflow[256];
+    char* into = input_len < sizeof(input) ? input + input_len : overflow;
+    size_t room = input_len < sizeof(input) ? sizeof(input) - input_len : sizeof(overflow);
+
+    ssize_t nread = read(STDIN_FILENO, into, room);
+    if (nread == -1 && (errno == EINTR || errno == EAGAIN))
     {
-        nread = read(STDIN_FILENO, &c, 1);
-        if (nread == -1 && errno != EAGAIN)
+        return 0;
+    }
+    if (nread <= 0)
+    {
+        return -1;
+    }
+
+    char* interrupt = memchr(into, CTRL_KEY('c'), nread);
+    if (into == overflow)
+    {
+        return interrupt != NULL;
+    }
+
+    // Monitor mode leaves ICRNL on, so Enter arrives as '\n'. The prompt expects it as raw mode delivers it.
+    for (char* p = into; p < into + nread; p++)
+    {
+        if (*p == '\n')
         {
-            perror("Could not read user input! ");
-            exit(1);
+            *p = '\r';
         }
     }
 
-    // This monitors if the character is an escape sequence,
-    // like the left arrow for example "\x1b[D".
-    if (c == '\x1b')
+    input_len += nread;
+    if (interrupt == NULL)
+    {
+        return 0;
+    }
+    memmove(interrupt, interrupt + 1, input + input_len - interrupt - 1);
+    input_len--;
+    return 1;
+}
+
+size_t editorTakeText(const char** text)
+{
+    size_t start = input_pos;
+    while (input_pos < input_len && (unsigned char) input[input_pos] >= ' ' && input[input_pos] != BACKSPACE)
+    {
+        input_pos++;
+    }
+
+    *text = input + start;
+    return input_pos - start;
+}
+
+int editorReadKey(void)
+{
+    while (input_pos == input_len)
     {
-        char seq[3];
-        if (read(STDIN_FILENO, &seq[0], 1) != 1) 
+        // Service the rest of the event loop while we wait for the user.
+        if (!eventWaitInput())
         {
-            return '\x1b';
+            return REFRESH_K;
         }
-        if (read(STDIN_FILENO, &seq[1], 1) != 1)
+        editorFillInput();
+    }
+
+    char c = input[input_pos++];
+    traceEvent(TRACE_KEY, (unsigned char) c);
+
+    // Escape sequences, like "\x1b[D" for the left arrow, are read until the decoder has all of it.
+    char seq[EDITOR_MAX_SEQUENCE] = { c };
+    size_t len = 1;
+    int key;
+
+    while (editorDecodeKey(seq, len, &key) == 0)
+    {
+        if (input_pos == input_len && !editorFillInput())
         {
             return '\x1b';
         }
+        seq[len++] = input[input_pos++];
+    }
+
+    return key;
+}
+
+size_t editorDecodeKey(const char* seq, size_t len, int* key)
+{
+    if (len == 0)
+    {
+        return 0;
+    }
+
+    *key = seq[0];
+    if (seq[0] != '\x1b')
+    {
+        return 1;
+    }
+
+    if (len < 3)
+    {
+        return 0;
+    }
 
-        if (seq[0] == '[') 
+    if (seq[1] == '[')
+    {
+        if (seq[2] >= '0' && seq[2] <= '9')
         {
-            if (seq[1] >= '0' && seq[1] <= '9')
+            if (len < 4)
             {
-                if (read(STDIN_FILENO, &seq[2], 1) != 1)
-                {
-                    return '\x1b';
-                }
-
-                if (seq[2] == '~')
-                {
-                    switch (seq[1])
-                    {
-                        case '3': return DEL_K;
-                        case '8': return BACKSPACE;
-                    }
-                }
+                return 0;
             }
-            else
+
+            if (seq[3] == '~')
             {
-                switch (seq[1])
+                switch (seq[2])
                 {
-                    case 'A': return ARROW_UP;
-                    case 'B': return ARROW_DOWN;
-                    case 'C': return ARROW_RIGHT;
-                    case 'D': return ARROW_LEFT;
+                    case '3': *key = DEL_K; break;
+                    case '8': *key = BACKSPACE; break;
                 }
             }
+            return 4;
         }
 
-        return '\x1b';
+        switch (seq[2])
+        {
+            case 'A': *key = ARROW_UP; break;
+            case 'B': *key = ARROW_DOWN; break;
+            case 'C': *key = ARROW_RIGHT; break;
+            case 'D': *key = ARROW_LEFT; break;
+        }
     }
 
-    return c;
+    return 3;
 }
 
 void editorDeleteCharacter(char** command, bool is_del)
@@ -253,67 +718,34 @@ void editorDeleteCharacter(char** command, bool is_del)
         return;
     }
 
-    char* tmp = *command;
-    char* new_command = malloc(command_len + 1);
-    strcpy(new_command, *command);
-
-    /**
-     * Copy over all of the characters from the old string to the new
-     * except the one at our cursor's position.
-     */
-    int pos = 0;
-    while (pos != str_pos)
-    {
-        char c = *(*command + pos);
-        new_command[pos] = c;
-        pos++;
-    }
-    pos++;
-    while (pos < command_len)
-    {
-        char c = *(*command + pos);
-        new_command[pos - 1] = c;
-        pos++;
-    }
-    new_command[pos - 1] = '\0';
-    *command = new_command;
-
-    free(tmp);
+    // Close the gap in place, the line only ever gets shorter here.
+    memmove(*command + str_pos, *command + str_pos + 1, command_len - str_pos);
 }
 
-void editorAddCharacter(char** command, int c)
+void editorInsertText(char** command, const char* text, size_t len)
 {
     size_t command_len = strlen(*command);
-    int str_pos = editor_state.x - editor_state.cwd_str_len;
-    char* tmp = *command;
-
-     /**
-     * Allocate enough memory for additional character. 
-     * We add two for the new 'c' character and the terminating '\0' character.
-     */
-    char* new_command = malloc(command_len + 2);
+    size_t str_pos = editor_state.x - editor_state.cwd_str_len;
 
-    int pos = 0;
-    while (pos != str_pos)
+    char* grown = realloc(*command, command_len + len + 1);
+    if (grown == NULL)
     {
-        char old_c = *(*command + pos);
-        new_command[pos] = old_c;
-        pos++;
-    }
-    new_command[pos] = c;
-    pos++;
-    while (pos < command_len + 1)
-    {
-        char c = *(*command + pos - 1);
-        new_command[pos] = c;
-        pos++;
+        perror("Could not allocate! ");
+        return;
     }
-    new_command[pos] = '\0';
-    *command = new_command;
 
-    // Free old one and move cursor forward.
-    editor_state.x++;
-    free(tmp);
+    // Open a gap at the cursor for the new text, moving the rest of the line and its terminating '\0' along.
+    memmove(grown + str_pos + len, grown + str_pos, command_len - str_pos + 1);
+    memcpy(grown + str_pos, text, len);
+    *command = grown;
+
+    editor_state.x += len;
+}
+
+void editorAddCharacter(char** command, int c)
+{
+    char character = c;
+    editorInsertText(command, &character, 1);
 }
 
 void editorMoveCursor(int c, char* command)
@@ -332,87 +764,66 @@ void editorMoveCursor(int c, char* command)
     }
 }
 
-void editorGetHistoryCommand(char* command, int arrow)
+void editorGetHistoryCommand(char** command, int arrow)
 {
-    if (arrow == ARROW_UP)
-    {
-        editor_state.history_pos--;
-    }
-
-    // Handles if we are at the last entry in history.
-    if (editor_state.history_pos < 0)
+    /**
+     * Other shells append to the same mapped ring, so pick up their commands
+     * first. If we were sitting on the empty line we stay on it.
+     * Duplicates are erased as they are appended, so every step lands on a distinct command.
+     */
+    uint64_t count = historyCount();
+    if (editor_state.history_pos >= editor_state.history_max ||
+        editor_state.history_generation != historyGeneration())
     {
-        editor_state.history_pos++;
-        return;
+        // A compaction renumbers every record, so start over from the empty line too.
+        editor_state.history_pos = count;
+        editor_state.history_generation = historyGeneration();
     }
+    editor_state.history_max = count;
 
-    if (arrow == ARROW_DOWN)
-    {
-        editor_state.history_pos++;
-
-        // Handles when we are at the first entry in history.
-        if (editor_state.history_pos >= editor_state.history_max)
-        {
-            editor_state.x = strlen(editor_state.cwd) + strlen(PROMPT) + 1;
-            strcpy(command, "");
-
-            if (editor_state.history_pos > editor_state.history_max)
-            {
-                editor_state.history_pos--;
-            }
-            return;
-        }
-    }
+    uint64_t first = historyFirst();
+    uint64_t pos = editor_state.history_pos < first ? first : editor_state.history_pos;
 
-    char* tmp = malloc(256);
-    strcpy(tmp, command);
+    size_t cap = 0;
+    char* entry = NULL;
 
-    FILE* file = fopen(program_wd, "r");
-    if (file == NULL)
+    while (true)
     {
-        // Return state back to what it was before the file opens.
         if (arrow == ARROW_UP)
         {
-            editor_state.history_pos++;
+            // Handles if we are at the last entry in history.
+            if (pos <= first)
+            {
+                free(entry);
+                return;
+            }
+            pos--;
         }
         else
         {
-            editor_state.history_pos--;
+            // Handles when we are at the first entry in history.
+            if (pos + 1 >= count)
+            {
+                editor_state.history_pos = count;
+                editor_state.x = editor_state.cwd_str_len;
+                strcpy(*command, "");
+                free(entry);
+                return;
+            }
+            pos++;
         }
 
-        perror("Could not open history file! ");
-        return;
-    }
-
-    int line_num = 0;
-    size_t len = 0;
-    char* line = NULL;
-
-    while ((getline(&line, &len, file)) != -1 && line_num != editor_state.history_pos)
-    {
-        line_num++;
-    }
-    fclose(file);
-
-    int newline_idx = strlen(line) - 1;
-    strcpy(command, line);
-
-    if (command[newline_idx] == '\n')
-    {
-        command[newline_idx] = '\0';
-    }
-
-    // This skips over duplicate commands.
-    if (strcmp(command, tmp) == 0)
-    {
-        editorGetHistoryCommand(command, arrow);
-        free(tmp);
-        return;
+        // Skip over records that were overwritten, and duplicates of the current command.
+        if (historyGet(pos, &entry, &cap, NULL) != -1 && strcmp(entry, *command) != 0)
+        {
+            break;
+        }
     }
 
-    free(tmp);
-    editor_state.x = strlen(editor_state.cwd) + strlen(PROMPT) + strlen(command) + 1;
-    return;
+    free(*command);
+    *command = entry;
+    editor_state.history_pos = pos;
+    editor_state.x = editor_state.cwd_str_len + strlen(*command);
 }
 
 char** editorGetArgs(char* command)
@@ -429,7 +840,7 @@ char** editorGetArgs(char* command)
         idx++;
 
         // Re-allocation incase the user supplies a lot of arguments.
-        if (idx >= USER_ARG_SIZE) 
+        if (idx >= user_arg_size) 
         {
             user_arg_size += USER_ARG_SIZE;
             tokens = realloc(tokens, user_arg_size * sizeof(char*));
@@ -446,255 +857,199 @@ char** editorGetArgs(char* command)
     return tokens;
 }
 
-char** getFileNames(int* filec, char* directory_str)
+struct dircache_listing* getFileNames(char* directory_str)
 {
-    DIR* d;
-    struct dirent* dir;
-    char** file_names = malloc(512);
-
-    d = opendir(directory_str);
-    if (d) 
+    // The cache is keyed by absolute path, so resolve relative directories against the prompt's cwd.
+    if (directory_str[0] == '/')
     {
-        while ((dir = readdir(d)) != NULL)
-        {
-            *(file_names + *filec) = dir->d_name;
-            ++*filec;
-        }
-        *(file_names + *filec) = NULL;
-    }
-    else
-    {
-        return NULL;
+        return dircacheGet(directory_str);
     }
 
-    if (closedir(d) == -1)
-    {
-        return NULL;
-    }
+    char* path = malloc(prompt_state.cwd_len + strlen(directory_str) + 2);
+    sprintf(path, "%s/%s", prompt_state.cwd, directory_str);
 
-    return file_names;
+    struct dircache_listing* listing = dircacheGet(path);
+    free(path);
+    return listing;
 }
 
 void editorTabComplete(char** command, bool shadow_tab)
 {
-    char directory_and_command[512] = "";
-    char directory_no_command[512] = "";
-    char directory[512] = "";
-
-    char last_arg[512] = "";
-    char other_args[512] = "";
-    bool beginning_slash = true;
-
-    char* command_cpy = malloc(strlen(*command) + 1);
-    strcpy(command_cpy, *command);
-
     /**
-     * Gather the command args in an array, and separate
-     * the last arg from the rest since that's the one we
-     * need to complete with tab.
+     * Only the last argument gets completed, so find where it starts and ends.
+     * Everything before it is kept as it was typed, however long the line is.
      */
-
-    char** args = editorGetArgs(*command);
-    int argc = 0;
-    while (args[argc] != NULL)
+    char* line = *command;
+    size_t end = strlen(line);
+    while (end > 0 && strchr(DELIMETERS, line[end - 1]) != NULL)
     {
-        argc++;
+        end--;
     }
 
-    if (argc == 0)
+    size_t start = end;
+    while (start > 0 && strchr(DELIMETERS, line[start - 1]) == NULL)
     {
-        free(*command);
-        *command = command_cpy;
-        return;
+        start--;
     }
 
-    // Get last arg.
-    strcpy(last_arg, args[argc - 1]);
-
-    // Gather the other args into a string.
-    args[--argc] = NULL;
-    for (int i = 0; i < argc; i++)
+    if (start == end)
     {
-        strcat(other_args, args[i]);
-        strcat(other_args, " ");
+        return;
     }
 
-    strcpy(directory, last_arg);
-    strcat(directory_and_command, last_arg);
-    strcat(directory_no_command, last_arg);
+    // The argument of a cd only completes to directories, ranked by how often and recently they were visited.
+    size_t first_word = strspn(line, DELIMETERS);
+    bool cd_arg = strncmp(line + first_word, "cd", 2) == 0 && line[first_word + 2] != '\0' &&
+                  strchr(DELIMETERS, line[first_word + 2]) != NULL && start > first_word + 2;
 
-    if (directory[0] != '/' && directory[0] != '.')
+    // Relative names are looked up in the current directory.
+    size_t last_len = end - start;
+    bool beginning_slash = line[start] == '/' || line[start] == '.';
+    char* directory = malloc(last_len + 3);
+    if (directory == NULL)
     {
-        beginning_slash = false;
-        char copy[510];
-        strcpy(copy, directory);
-        sprintf(directory, "./%s", copy);
-        sprintf(directory_no_command, "./%s", copy);
-        sprintf(directory_and_command, "./%s", copy);
+        return;
     }
+    sprintf(directory, "%s%.*s", beginning_slash ? "" : "./", (int) last_len, line + start);
 
-    for (int i = strlen(directory) - 1; i >= 0; i--)
+    // Split the last arg into the directory part and the partial file name after its last slash.
+    char* slash = strrchr(directory, '/');
+    if (slash == NULL || slash[1] == '\0')
     {
-        if (directory[i] == '/')
-        {
-            directory[i + 1] = '\0';
-            directory_no_command[i + 1] = '\0';
-            break;
-        }
+        free(directory);
+        return;
     }
-
-    if (strcmp(directory_no_command, directory_and_command) == 0)
+    const char* partial = slash + 1;
+    size_t partial_len = strlen(partial);
+
+    char partial_start = slash[1];
+    slash[1] = '\0';
+    struct dircache_listing* listing = getFileNames(directory);
+    slash[1] = partial_start;
+    if (listing == NULL)
     {
-        free(*command);
-        *command = command_cpy;
+        free(directory);
         return;
     }
 
     /**
-     * Below is the logic for auto-completing the command string.
-     * We basically just add a character to the command one at a time.
-     * If file name in our command ends up
-     * matching a lower number of files than the amount
-     * of matches we got at the beginning, then the auto-complete
-     * is done, and we're ready to alter the command.
+     * The completion is the longest prefix shared by every file name starting with
+     * what was typed. If only one file matches it's the whole name, and directories
+     * get a trailing slash so the next tab can carry on into them.
      */
-
-    // Get file names and file count of directory.
-    int filec = 0;
-    char** file_names = getFileNames(&filec, directory);
-    if (file_names == NULL)
+    const char* first_match = NULL;
+    size_t common_len = 0;
+    bool is_dir = false;
+    int matched_files = 0;
+
+    // Candidates for a cd are scored by their absolute path, built in candidate behind the directory.
+    char* candidate = NULL;
+    size_t candidate_len = 0;
+    const char* best_ranked = NULL;
+    double best_score = 0;
+    if (cd_arg)
     {
-        return;
+        const char* cwd = strcmp(prompt_state.cwd, "/") == 0 ? "" : prompt_state.cwd;
+        candidate = malloc(strlen(cwd) + (partial - directory) + NAME_MAX + 2);
+        if (candidate != NULL && directory[0] == '/')
+        {
+            candidate_len = sprintf(candidate, "%.*s", (int) (partial - directory), directory);
+        }
+        else if (candidate != NULL)
+        {
+            const char* relative = strncmp(directory, "./", 2) == 0 ? directory + 2 : directory;
+            candidate_len = sprintf(candidate, "%s/%.*s", cwd, (int) (partial - relative), relative);
+        }
     }
 
-    /**
-     * We finish searching if the file name in our command gets as long as the longest file.
-     * Or if we get less file name matches than what we got at the start.
-     */
-    bool finished_matching = false;
-
-    // We use first search on our first run to get the largest file name.
-    bool first_search = true;
-
-    // If we don't find any matching files in the dir we can just end early.
-    bool found_match = false;
-
-    /**
-     * If we ever match less files than what we find on our first search, than
-     * we've autocompleted as far as we can go.
-     */
-    int minimum_matched_files = 0;
-
-    // Number of characters we've added to our command. Starts at -1 for the first search.
-    int chars_match = -1;
-
-    int starting_len = strlen(directory_and_command) - strlen(directory_no_command);
-    char largest_file[512] = "";
-
-    while (!finished_matching)
+    for (int i = 0; i < listing->count; i++)
     {
-        int matched_files = 0;
-        for (int i = 0; i < filec; i++)
+        const char* name = listing->names[i];
+        if (strncmp(name, partial, partial_len) != 0 || (cd_arg && listing->types[i] != DT_DIR))
         {
-            // Create a command that just includes the last arg + the file name in the cwd.
-            char* compare_command = malloc(strlen(directory_no_command) + strlen(*(file_names + i)) + 1);
-            sprintf(compare_command, "%s%s", directory_no_command, *(file_names + i));
+            continue;
+        }
 
-            // Compare and see if the characters leading up are equal, if so we've found a match.
-            if (strncmp(directory_and_command, compare_command, strlen(directory_and_command)) == 0)
+        if (candidate != NULL)
+        {
+            snprintf(candidate + candidate_len, NAME_MAX + 1, "%s", name);
+            double score = jumpScore(candidate);
+            if (score > best_score)
             {
-                if (strlen(*(file_names + i)) > strlen(largest_file))
-                {
-                    strcpy(largest_file, *(file_names + i));
-                }
-
-                matched_files++;
-                found_match = true;
+                best_ranked = name;
+                best_score = score;
             }
-            free(compare_command);
         }
 
-        if (!found_match)
+        if (matched_files++ == 0)
         {
-            free(*command);
-            *command = command_cpy;
-            return;
+            first_match = name;
+            common_len = strlen(name);
+            is_dir = listing->types[i] == DT_DIR;
+            continue;
         }
 
-        if (first_search)
+        size_t shared = partial_len;
+        while (shared < common_len && name[shared] == first_match[shared])
         {
-            first_search = false;
-            minimum_matched_files = matched_files;
-            chars_match++;
+            shared++;
         }
-        else
-        {
-            int new_starting_len = strlen(directory_and_command) - strlen(directory_no_command);
-            if (matched_files < minimum_matched_files || new_starting_len == strlen(largest_file))
-            {
-                if (matched_files < minimum_matched_files)
-                {
-                    directory_and_command[strlen(directory_and_command) - 1] = '\0';
-                    new_starting_len--;
-                }
-
-                if (!beginning_slash)
-                {
-                    char* tmp = malloc(strlen(directory_and_command) - 1);
-                    sprintf(tmp, "%s", directory_and_command + 2);
-                    strcpy(directory_and_command, tmp);
-                    free(tmp);
-                }
+        common_len = shared;
+    }
 
-                char* new_command = malloc(strlen(other_args) + strlen(directory_and_command) + 2);
-                sprintf(new_command, "%s%s", other_args, directory_and_command);
+    free(candidate);
 
-                if (new_starting_len == strlen(largest_file))
-                {
-                    DIR* d;
-                    struct dirent* dir;
+    bool add_slash = matched_files == 1 && is_dir;
+    const char* completed = beginning_slash ? directory : directory + 2;
+    size_t directory_len = partial - completed;
 
-                    d = opendir(directory);
-                    if (d) 
-                    {
-                        while ((dir = readdir(d)) != NULL)
-                        {
-                            if (strcmp(dir->d_name, largest_file) == 0 && dir->d_type == DT_DIR)
-                            {
-                                strcat(new_command, "/");
-                                break;
-                            }
-                        }
-                    }
-                    else
-                    {
-                        perror("Could not open directory! ");
-                    }
+    if (best_ranked != NULL && matched_files > 1)
+    {
+        first_match = best_ranked;
+        common_len = strlen(best_ranked);
+        add_slash = true;
+    }
+    else if (cd_arg && matched_files == 0 && !beginning_slash && slash == directory + 1)
+    {
+        // Nothing here matches, so complete to a visited directory with that name instead.
+        first_match = jumpComplete(partial, partial_len);
+        common_len = first_match != NULL ? strlen(first_match) : 0;
+        directory_len = 0;
+        add_slash = true;
+    }
 
-                    if (closedir(d) == -1)
-                    {
-                        perror("Could not close directory!");
-                    }
-                }
+    if (first_match == NULL)
+    {
+        dircacheRelease(listing);
+        free(directory);
+        return;
+    }
 
-                free(*command);
-                free(command_cpy);
-                free(file_names);
+    char* new_command = malloc(start + directory_len + common_len + 2);
+    if (new_command != NULL)
+    {
+        char* p = new_command;
+        memcpy(p, line, start);
+        p += start;
+        memcpy(p, completed, directory_len);
+        p += directory_len;
+        memcpy(p, first_match, common_len);
+        p += common_len;
+        if (add_slash)
+        {
+            *p++ = '/';
+        }
+        *p = '\0';
 
-               *command = new_command;
+        free(*command);
+        *command = new_command;
 
-                if (!shadow_tab)
-                {
-                    editor_state.x = strlen(editor_state.cwd) + strlen(PROMPT) + strlen(*command) + 1;
-                }
-                finished_matching = true;
-            }
-            else
-            {
-                char new_char = (largest_file)[chars_match + starting_len];
-                strncat(directory_and_command, &new_char, 1);
-                chars_match++;
-            }
+        if (!shadow_tab)
+        {
+            editor_state.x = editor_state.cwd_str_len + (p - new_command);
         }
     }
+
+    dircacheRelease(listing);
+    free(directory);
 }
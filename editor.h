@@ -1,6 +1,7 @@
 #ifndef EDITOR_H
 #define EDITOR_H
 
+#include <stdint.h>
 #include <termios.h>
 #include "boone.h"
 
@@ -10,15 +11,32 @@
 #define DELIMETERS " \t\r\n\a"
 #define PROMPT " ; "
 
+// Longest escape sequence editorDecodeKey understands.
+#define EDITOR_MAX_SEQUENCE 4
+
+// Most bytes of typed or pasted input read from the terminal at once.
+#define EDITOR_READ_CHUNK 65536
+
+// Window size assumed when the terminal can't tell us its own.
+#define EDITOR_DEFAULT_ROWS 24
+#define EDITOR_DEFAULT_COLS 80
+
+// The cwd, prompt segments, PROMPT, the command and the completion hint.
+#define EDITOR_PIECES 5
+
 struct state 
 {
     int x;
+
+    // Top row of the edit area, which grows upwards from the bottom of the screen as the command wraps.
     int y;
+    int rows;
+    int cols;
     int cwd_str_len;
-    int history_pos;
-    int history_max;
+    uint64_t history_pos;
+    uint64_t history_max;
+    uint64_t history_generation;
     char* tab_command;
-    char* cwd;
 };
 
 enum editor_keys 
@@ -28,9 +46,14 @@ enum editor_keys
     ARROW_DOWN,
     ARROW_LEFT,
     ARROW_RIGHT,
-    DEL_K
+    DEL_K,
+
+    // Not a real key, returned when the event loop asks for the prompt to be redrawn.
+    REFRESH_K
 };
 
+struct boone_output;
+
 extern struct termios orig_termios;
 extern struct state editor_state;
 
@@ -41,23 +64,38 @@ void disableModes(void);
 
 // Functions for the command line editor.
 
-// Refreshes the screen after each keypress.
+// Reads the window size and keeps it up to date through SIGWINCH.
+void editorInitWindow(void);
+
+// Refreshes the screen after each keypress, redrawing only the rows that changed.
 void editorRefreshScreen(char* command);
 
+// Moves below the edit area once a command is entered, so the next refresh starts a new prompt.
+void editorEndLine(void);
+
+/**
+ * Appends to out what it takes to print the lines of text above the edit area
+ * without disturbing it. Without a prompt on screen they are simply written out.
+ */
+void editorPrintAbove(struct boone_output* out, const char* text, size_t len);
+
 // Handles the left and right keys for moving the cursor around the command string.
 void editorMoveCursor(int c, char* command);
 
 // Handles adding characters to the command string.
 void editorAddCharacter(char** command, int c);
 
+// Inserts len bytes of text at the cursor, growing the command string in place.
+void editorInsertText(char** command, const char* text, size_t len);
+
 // Handles the backspace and delete key to remove characters from the command string.
 void editorDeleteCharacter(char** command, bool is_del);
 
 // Handles the up and down arrow keys which retrieve previous command strings.
-void editorGetHistoryCommand(char* command, int arrow);
+void editorGetHistoryCommand(char** command, int arrow);
 
-// Returns an array of file names found in a given directory string. Stores file count in filec.
-char** getFileNames(int* filec, char* directory_str);
+// Returns the cached listing of the files in a given directory string. Release it with dircacheRelease.
+struct dircache_listing* getFileNames(char* directory_str);
 
 // Handles the tab key which auto-completes the command str.
 void editorTabComplete(char** command, bool shadow_tab);
@@ -68,10 +106,32 @@ bool editorProcessKeypress(char** command, bool monitor_f);
 // Get all of the arguments in the commands string.
 char** editorGetArgs(char* command);
 
+/**
+ * Decodes the key at the start of seq. Returns how many bytes it took, or 0 if seq
+ * only holds the start of an escape sequence and more bytes are needed.
+ */
+size_t editorDecodeKey(const char* seq, size_t len, int* key);
+
  /**
  * Read key from the keyboard. Returns an integer type instead of a char type
  * to handle control key presses instead of a character key presses.
  */
 int editorReadKey(void);
 
+// Returns true if more input is already waiting, read or not, so redrawing can wait until it's handled.
+bool editorInputPending(void);
+
+/**
+ * Reads what was typed while the shell is busy running something into the input
+ * buffer, so the next prompt still gets it. Returns 1 if a Ctrl-C was among it,
+ * which is taken out, and -1 once stdin is at end of file or failed.
+ */
+int editorBufferTypeahead(void);
+
+/**
+ * Consumes the run of printable bytes at the front of the input that editorReadKey has
+ * read but not decoded yet. Returns its length and points text at it.
+ */
+size_t editorTakeText(const char** text);
+
 #endif
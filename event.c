@@ -0,0 +1,181 @@
+#include "event.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+
+#define EVENT_BATCH 32
+
+struct event_watch
+{
+    event_handler handler;
+    void* data;
+};
+
+static int event_fd = -1;
+static bool event_refresh = false;
+static bool event_input = true;
+static void (*event_flush)(void) = NULL;
+
+// Watches indexed by file descriptor, so a handler removing another watch can't leave a dangling pointer.
+static struct event_watch* event_watches = NULL;
+static int event_watches_cap = 0;
+
+static int eventInit(void)
+{
+    if (event_fd != -1)
+    {
+        return 0;
+    }
+
+    event_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (event_fd == -1)
+    {
+        perror("Could not create event loop! ");
+        return -1;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = STDIN_FILENO };
+    if (epoll_ctl(event_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == -1)
+    {
+        perror("Could not watch standard input! ");
+        close(event_fd);
+        event_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+int eventAdd(int fd, event_handler handler, void* data)
+{
+    if (eventInit() == -1)
+    {
+        return -1;
+    }
+
+    if (fd >= event_watches_cap)
+    {
+        int cap = event_watches_cap == 0 ? 64 : event_watches_cap;
+        while (cap <= fd)
+        {
+            cap *= 2;
+        }
+
+        struct event_watch* grown = realloc(event_watches, cap * sizeof(struct event_watch));
+        if (grown == NULL)
+        {
+            perror("Could not allocate! ");
+            return -1;
+        }
+        memset(grown + event_watches_cap, 0, (cap - event_watches_cap) * sizeof(struct event_watch));
+        event_watches = grown;
+        event_watches_cap = cap;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = fd };
+    if (epoll_ctl(event_fd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    {
+        perror("Could not add to event loop! ");
+        return -1;
+    }
+
+    event_watches[fd].handler = handler;
+    event_watches[fd].data = data;
+    return 0;
+}
+
+void eventRemove(int fd)
+{
+    if (event_fd == -1 || fd >= event_watches_cap || event_watches[fd].handler == NULL)
+    {
+        return;
+    }
+
+    epoll_ctl(event_fd, EPOLL_CTL_DEL, fd, NULL);
+    event_watches[fd].handler = NULL;
+    event_watches[fd].data = NULL;
+}
+
+void eventWatchInput(bool watch)
+{
+    if (eventInit() == -1 || watch == event_input)
+    {
+        return;
+    }
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.fd = STDIN_FILENO };
+    if (epoll_ctl(event_fd, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, STDIN_FILENO, &ev) == -1)
+    {
+        perror("Could not watch standard input! ");
+        return;
+    }
+    event_input = watch;
+}
+
+void eventRequestRefresh(void)
+{
+    event_refresh = true;
+}
+
+void eventSetFlush(void (*flush)(void))
+{
+    event_flush = flush;
+}
+
+bool eventWaitInput(void)
+{
+    // Without an event loop we just fall back to a blocking read.
+    if (eventInit() == -1)
+    {
+        return true;
+    }
+
+    while (true)
+    {
+        if (event_refresh)
+        {
+            event_refresh = false;
+            return false;
+        }
+
+        struct epoll_event events[EVENT_BATCH];
+        int ready = epoll_wait(event_fd, events, EVENT_BATCH, -1);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Could not wait for events! ");
+            return true;
+        }
+
+        bool input = false;
+        for (int i = 0; i < ready; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == STDIN_FILENO)
+            {
+                input = true;
+            }
+            else if (fd < event_watches_cap && event_watches[fd].handler != NULL)
+            {
+                event_watches[fd].handler(fd, event_watches[fd].data);
+            }
+        }
+
+        if (event_flush != NULL)
+        {
+            event_flush();
+        }
+
+        if (input)
+        {
+            return true;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdbool.h>
+
+/**
+ * The shell's event loop. Reading a key waits here, so any file descriptor
+ * registered with a handler gets serviced while the shell sits at the prompt
+ * or waits on a foreground program.
+ */
+
+typedef void (*event_handler)(int fd, void* data);
+
+// Calls handler(fd, data) whenever fd becomes readable.
+int eventAdd(int fd, event_handler handler, void* data);
+void eventRemove(int fd);
+
+// Asks the editor to redraw the prompt once the current handlers have run.
+void eventRequestRefresh(void);
+
+// Sets a function called once the handlers of each wakeup have all run, so their output can go out in one write.
+void eventSetFlush(void (*flush)(void));
+
+// Blocks until stdin is readable and returns true, or returns false if a handler asked for a redraw first.
+bool eventWaitInput(void);
+
+/**
+ * Stops or resumes watching stdin. Used once it is at end of file while the shell
+ * waits on something else, eventWaitInput then only returns for a redraw.
+ */
+void eventWatchInput(bool watch);
+
+#endif
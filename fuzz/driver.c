@@ -0,0 +1,90 @@
+/**
+ * Stands in for libFuzzer's main when clang isn't around. Runs each file named on
+ * the command line through the harness, or with none, -runs=N random inputs made
+ * mostly of the bytes the editor and lexer treat specially.
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define FUZZ_MAX_INPUT 4096
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+
+static const char fuzz_alphabet[] = "\x1b[~0123456789ABCDabc ${}()\t\r\n\a/.-\x7f";
+
+static int fuzzRunFile(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror("Could not open fuzz input! ");
+        return -1;
+    }
+
+    uint8_t* data = malloc(FUZZ_MAX_INPUT);
+    size_t size = fread(data, 1, FUZZ_MAX_INPUT, file);
+    fclose(file);
+
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    long runs = 100000;
+    unsigned int seed = time(NULL);
+    int files = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "-runs=", 6) == 0)
+        {
+            runs = strtol(argv[i] + 6, NULL, 10);
+        }
+        else if (strncmp(argv[i], "-seed=", 6) == 0)
+        {
+            seed = strtoul(argv[i] + 6, NULL, 10);
+        }
+        else
+        {
+            files++;
+            if (fuzzRunFile(argv[i]) == -1)
+            {
+                return 1;
+            }
+        }
+    }
+
+    if (files > 0)
+    {
+        return 0;
+    }
+
+    printf("Running %ld random inputs with -seed=%u\n", runs, seed);
+    srand(seed);
+
+    uint8_t* data = malloc(FUZZ_MAX_INPUT);
+    for (long run = 0; run < runs; run++)
+    {
+        // Mostly short inputs, with the odd long one to get past the fixed size buffers.
+        size_t size = rand() % 16 == 0 ? rand() % FUZZ_MAX_INPUT : rand() % 64;
+        for (size_t i = 0; i < size; i++)
+        {
+            data[i] = rand() % 4 == 0 ? rand() % 256 : fuzz_alphabet[rand() % (sizeof(fuzz_alphabet) - 1)];
+        }
+
+        // A copy of exactly the input's size, so the sanitizers see reads past its end.
+        uint8_t* input = malloc(size);
+        memcpy(input, data, size);
+        LLVMFuzzerTestOneInput(input, size);
+        free(input);
+    }
+
+    free(data);
+    printf("Done, no crashes\n");
+    return 0;
+}
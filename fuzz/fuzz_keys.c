@@ -0,0 +1,64 @@
+/**
+ * Decodes the input as keypresses and applies them to a command line the way
+ * editorProcessKeypress does, checking the cursor never leaves the line.
+ */
+#include "../boone.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    // An exact size copy, so reading past the end of the input trips the address sanitizer.
+    char* input = malloc(size);
+    memcpy(input, data, size);
+
+    editor_state.cwd_str_len = 8;
+    editor_state.x = editor_state.cwd_str_len;
+    char* command = strdup("");
+
+    size_t pos = 0;
+    while (pos < size)
+    {
+        int key;
+        size_t used = editorDecodeKey(input + pos, size - pos, &key);
+        if (used == 0)
+        {
+            break;
+        }
+        if (used > size - pos || used > EDITOR_MAX_SEQUENCE)
+        {
+            abort();
+        }
+        pos += used;
+
+        switch (key)
+        {
+            case ARROW_LEFT:
+            case ARROW_RIGHT:
+                editorMoveCursor(key, command);
+                break;
+
+            case DEL_K:
+                editorDeleteCharacter(&command, true);
+                break;
+
+            case BACKSPACE:
+                editorDeleteCharacter(&command, false);
+                break;
+
+            default:
+                if (!iscntrl(key) && key != '\0')
+                {
+                    editorAddCharacter(&command, key);
+                }
+        }
+
+        int cursor = editor_state.x - editor_state.cwd_str_len;
+        if (cursor < 0 || cursor > strlen(command))
+        {
+            abort();
+        }
+    }
+
+    free(command);
+    free(input);
+    return 0;
+}
@@ -0,0 +1,79 @@
+/**
+ * Tokenizes the input with editorGetArgs and, unless it holds a substitution,
+ * checks lexerExpand splits it the same way. Lines with variables are expanded
+ * against a small fixed table instead, and only have to come out as words.
+ * The names are made of letters the driver's alphabet generates.
+ */
+#include "../boone.h"
+
+static void fuzzVariables(void)
+{
+    static bool set = false;
+    if (!set)
+    {
+        varsSet("A", 1, "/home/fuzz", true);
+        varsSet("b", 1, " several  words\there ", false);
+        varsSet("C", 1, "", false);
+        set = true;
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    fuzzVariables();
+
+    char* line = malloc(size + 1);
+    memcpy(line, data, size);
+    line[size] = '\0';
+
+    char* copy = strdup(line);
+    char** args = editorGetArgs(copy);
+
+    // A substitution would run whatever command the fuzzer came up with, so those only go through editorGetArgs.
+    if (strstr(line, "$(") == NULL)
+    {
+        bool variables = strchr(line, '$') != NULL;
+        bool braces = strstr(line, "${") != NULL;
+
+        char** expanded = lexerExpand(line);
+        if (expanded == NULL)
+        {
+            // Only an unterminated ${ is a syntax error.
+            if (!braces)
+            {
+                abort();
+            }
+        }
+        else if (variables)
+        {
+            for (int i = 0; expanded[i] != NULL; i++)
+            {
+                if (expanded[i][0] == '\0' || strpbrk(expanded[i], DELIMETERS) != NULL)
+                {
+                    abort();
+                }
+            }
+        }
+        else
+        {
+            int i = 0;
+            for (; args[i] != NULL; i++)
+            {
+                if (expanded[i] == NULL || strcmp(args[i], expanded[i]) != 0)
+                {
+                    abort();
+                }
+            }
+            if (expanded[i] != NULL)
+            {
+                abort();
+            }
+        }
+        free(expanded);
+    }
+
+    free(args);
+    free(copy);
+    free(line);
+    return 0;
+}
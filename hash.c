@@ -0,0 +1,83 @@
+#include "hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+uint64_t hashBytes(const void* data, size_t len)
+{
+    const unsigned char* bytes = data;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash == 0 ? 1 : hash;
+}
+
+int hashIndexReset(struct hash_index* index, size_t count)
+{
+    size_t cap = 64;
+    while (cap < count * 2 + 2)
+    {
+        cap *= 2;
+    }
+
+    if (cap == index->cap)
+    {
+        hashIndexClear(index);
+        return 0;
+    }
+
+    struct hash_slot* slots = calloc(cap, sizeof(struct hash_slot));
+    if (slots == NULL)
+    {
+        return -1;
+    }
+
+    free(index->slots);
+    index->slots = slots;
+    index->cap = cap;
+    index->used = 0;
+    return 0;
+}
+
+void hashIndexClear(struct hash_index* index)
+{
+    if (index->slots != NULL)
+    {
+        memset(index->slots, 0, index->cap * sizeof(struct hash_slot));
+    }
+    index->used = 0;
+}
+
+void hashIndexFree(struct hash_index* index)
+{
+    free(index->slots);
+    index->slots = NULL;
+    index->cap = 0;
+    index->used = 0;
+}
+
+struct hash_slot* hashIndexFirst(const struct hash_index* index, uint64_t hash)
+{
+    return index->slots != NULL ? &index->slots[hash & (index->cap - 1)] : NULL;
+}
+
+struct hash_slot* hashIndexNext(const struct hash_index* index, const struct hash_slot* slot)
+{
+    return &index->slots[(slot - index->slots + 1) & (index->cap - 1)];
+}
+
+void hashIndexInsert(struct hash_index* index, uint64_t hash, uint64_t value)
+{
+    struct hash_slot* slot = hashIndexFirst(index, hash);
+    while (slot->value != 0)
+    {
+        slot = hashIndexNext(index, slot);
+    }
+
+    slot->hash = hash;
+    slot->value = value;
+    index->used++;
+}
@@ -0,0 +1,48 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * Open addressed index of (hash, value) slots with linear probing, used by the
+ * history fingerprints, the jump index and the variable table. A value of 0
+ * marks an empty slot, so callers store an entry index or sequence number + 1,
+ * and check that the entry a matching hash leads to really is the one they want.
+ */
+struct hash_slot
+{
+    uint64_t hash;
+    uint64_t value;
+};
+
+struct hash_index
+{
+    struct hash_slot* slots;
+    size_t cap;
+    size_t used;
+};
+
+// FNV-1a of len bytes, never 0.
+uint64_t hashBytes(const void* data, size_t len);
+
+/**
+ * Empties the index, resizing it so count entries keep it at most half full.
+ * Returns -1 if the new size couldn't be allocated, leaving the index as it was.
+ */
+int hashIndexReset(struct hash_index* index, size_t count);
+
+void hashIndexClear(struct hash_index* index);
+void hashIndexFree(struct hash_index* index);
+
+/**
+ * The first slot along the probe chain of hash, or NULL if the index was never
+ * allocated. hashIndexNext steps along it, which ends at the first empty slot.
+ */
+struct hash_slot* hashIndexFirst(const struct hash_index* index, uint64_t hash);
+struct hash_slot* hashIndexNext(const struct hash_index* index, const struct hash_slot* slot);
+
+// Puts value in the first empty slot along the probe chain of hash. The index must have room for it.
+void hashIndexInsert(struct hash_index* index, uint64_t hash, uint64_t value);
+
+#endif
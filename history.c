@@ -0,0 +1,847 @@
+#include "hash.h"
+#include "history.h"
+#include "worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+struct history_map
+{
+    struct history_header* header;
+    struct history_slot* slots;
+    char* data;
+    size_t size;
+    ino_t inode;
+};
+
+// What the worker thread is given to compact.
+struct history_compaction
+{
+    struct history_map old;
+    uint32_t slot_count;
+};
+
+// Slots as laid out by version 1 files, from before commands recorded how they ran.
+struct history_slot_v1
+{
+    uint64_t seq;
+    uint64_t offset;
+    uint32_t length;
+    uint32_t flags;
+    int64_t timestamp;
+};
+
+// The map the main thread reads and appends to.
+static struct history_map history;
+
+// A replaced map our own worker is still compacting, kept mapped until it is done.
+static struct history_map retired;
+
+static char history_path[PATH_MAX];
+static uint64_t history_generation = 0;
+static atomic_bool history_compacting = false;
+
+// BOONE_HISTSIZE as it was at startup, and whether we have already resized a file to it.
+static uint32_t history_slots = HISTORY_SLOTS;
+static bool history_resized = false;
+
+/**
+ * Fingerprints of every live record, used to find the older copy of a command
+ * in O(1) when it is appended again. Each holds the record's sequence number + 1.
+ */
+static struct hash_index fingerprints;
+static uint64_t fingerprint_synced = 0;
+
+static uint32_t historyWantedSlots(void)
+{
+    char* env = getenv("BOONE_HISTSIZE");
+    if (env == NULL)
+    {
+        return HISTORY_SLOTS;
+    }
+
+    long slots = strtol(env, NULL, 10);
+    if (slots < HISTORY_MIN_SLOTS)
+    {
+        return HISTORY_MIN_SLOTS;
+    }
+    if (slots > UINT32_MAX / 2)
+    {
+        return UINT32_MAX / 2;
+    }
+    return slots;
+}
+
+static size_t historyMapSize(uint32_t slot_count, uint64_t data_size)
+{
+    return sizeof(struct history_header) + slot_count * sizeof(struct history_slot) + data_size;
+}
+
+static void historyUnmap(struct history_map* map)
+{
+    if (map->header != NULL)
+    {
+        munmap(map->header, map->size);
+        map->header = NULL;
+    }
+}
+
+// Maps fd, which must already hold an initialized history file.
+static int historyMapFd(int fd, struct history_map* map)
+{
+    struct history_header header;
+    struct stat st;
+
+    if (pread(fd, &header, sizeof(header), 0) != sizeof(header) || fstat(fd, &st) == -1)
+    {
+        return -1;
+    }
+
+    size_t size = historyMapSize(header.slot_count, header.data_size);
+    if (st.st_size < size)
+    {
+        fprintf(stderr, "History file is truncated!\n");
+        return -1;
+    }
+
+    void* addr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+        perror("Could not map history file! ");
+        return -1;
+    }
+
+    map->header = addr;
+    map->slots = (struct history_slot*) (map->header + 1);
+    map->data = (char*) (map->slots + map->header->slot_count);
+    map->size = size;
+    map->inode = st.st_ino;
+
+    return 0;
+}
+
+// Truncates fd and writes an empty ring with the given number of slots into it.
+static int historyInit(int fd, uint32_t slot_count)
+{
+    struct history_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.slot_count = slot_count;
+    header.data_size = (uint64_t) slot_count * HISTORY_AVG_RECORD;
+
+    // Truncating first zeroes every slot, which marks them all as empty.
+    size_t size = historyMapSize(header.slot_count, header.data_size);
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1 ||
+        pwrite(fd, &header, sizeof(header), 0) != sizeof(header))
+    {
+        perror("Could not initialize history file! ");
+        return -1;
+    }
+
+    return 0;
+}
+
+static void historyUpgrade(struct history_map* map, const struct history_header* header, const char* old);
+
+// Reads a whole version 1 file into memory, so its records can be copied into the file that replaces it.
+static char* historyReadOld(int fd, const struct history_header* header)
+{
+    size_t size = sizeof(struct history_header) + header->slot_count * sizeof(struct history_slot_v1) + header->data_size;
+    char* old = malloc(size);
+    if (old != NULL && pread(fd, old, size, 0) != size)
+    {
+        free(old);
+        old = NULL;
+    }
+    return old;
+}
+
+static int historyMapPath(const char* path, struct history_map* map)
+{
+    int created = 0;
+    int fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (fd == -1)
+    {
+        perror("Could not open history file! ");
+        return -1;
+    }
+
+    // The header is written last, so a file that already has a current one can be mapped without the lock.
+    struct history_header header;
+    ssize_t nread = pread(fd, &header, sizeof(header), 0);
+    if (nread == sizeof(header) && header.magic == HISTORY_MAGIC && header.version == HISTORY_VERSION)
+    {
+        int mapped = historyMapFd(fd, map);
+        close(fd);
+        return mapped;
+    }
+
+    // Only one shell gets to initialize the file, the others wait here and then map what it wrote.
+    if (flock(fd, LOCK_EX) == -1)
+    {
+        perror("Could not lock history file! ");
+        close(fd);
+        return -1;
+    }
+
+    nread = pread(fd, &header, sizeof(header), 0);
+    bool valid = nread == sizeof(header) && header.magic == HISTORY_MAGIC;
+    char* old = valid && header.version == 1 ? historyReadOld(fd, &header) : NULL;
+
+    if (!valid || header.version != HISTORY_VERSION)
+    {
+        if (historyInit(fd, history_slots) == -1)
+        {
+            free(old);
+            close(fd);
+            return -1;
+        }
+
+        // An upgraded file keeps its records, only a new one should import the plain text history.
+        created = old == NULL;
+    }
+
+    int mapped = historyMapFd(fd, map);
+    if (mapped != -1 && old != NULL)
+    {
+        historyUpgrade(map, &header, old);
+    }
+    free(old);
+    flock(fd, LOCK_UN);
+    close(fd);
+
+    return mapped == -1 ? -1 : created;
+}
+
+static void historyResetFingerprints(void)
+{
+    hashIndexClear(&fingerprints);
+    fingerprint_synced = 0;
+}
+
+int historyOpen(const char* path)
+{
+    snprintf(history_path, sizeof(history_path), "%s", path);
+    history_slots = historyWantedSlots();
+    return historyMapPath(path, &history);
+}
+
+void historyClose(void)
+{
+    // Let a compaction running on the worker thread finish rather than leave the file half replaced.
+    while (atomic_load(&history_compacting))
+    {
+        usleep(1000);
+    }
+    historyUnmap(&history);
+    historyUnmap(&retired);
+}
+
+void historyImport(const char* path)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return;
+    }
+
+    size_t cap = 0;
+    char* line = NULL;
+    ssize_t len;
+
+    while ((len = getline(&line, &cap, file)) != -1)
+    {
+        if (len > 0 && line[len - 1] == '\n')
+        {
+            line[--len] = '\0';
+        }
+        if (len > 0)
+        {
+            historyAppend(line, len);
+        }
+    }
+
+    free(line);
+    fclose(file);
+}
+
+// Copies bytes into or out of the data ring, splitting the copy where the ring wraps.
+static void historyCopyIn(struct history_map* map, uint64_t offset, const char* src, size_t len)
+{
+    size_t data_size = map->header->data_size;
+    size_t pos = offset % data_size;
+    size_t first = data_size - pos < len ? data_size - pos : len;
+
+    memcpy(map->data + pos, src, first);
+    memcpy(map->data, src + first, len - first);
+}
+
+static void historyCopyOut(struct history_map* map, uint64_t offset, char* dst, size_t len)
+{
+    size_t data_size = map->header->data_size;
+    size_t pos = offset % data_size;
+    size_t first = data_size - pos < len ? data_size - pos : len;
+
+    memcpy(dst, map->data + pos, first);
+    memcpy(dst + first, map->data, len - first);
+}
+
+static uint64_t historyMapFirst(struct history_map* map)
+{
+    uint64_t count = atomic_load_explicit(&map->header->next_seq, memory_order_acquire);
+    return count < map->header->slot_count ? 0 : count - map->header->slot_count;
+}
+
+static uint64_t historyMapAppend(struct history_map* map, const char* command, size_t len, const struct history_stats* stats)
+{
+    uint64_t seq = atomic_fetch_add(&map->header->next_seq, 1);
+    uint64_t offset = atomic_fetch_add(&map->header->next_byte, len);
+    struct history_slot* slot = &map->slots[seq % map->header->slot_count];
+
+    // Invalidate the slot first so a reader never pairs the old record's metadata with our text.
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    historyCopyIn(map, offset, command, len);
+    slot->offset = offset;
+    slot->length = len;
+    slot->timestamp = stats->timestamp;
+    slot->duration_us = stats->duration_us;
+    slot->cpu_us = stats->cpu_us;
+    slot->status = stats->status;
+    atomic_store_explicit(&slot->flags, stats->status == -1 ? 0 : HISTORY_FINISHED, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, seq + 1, memory_order_release);
+    return seq;
+}
+
+// Copies the live records of a version 1 file into map, which is still locked and private to us.
+static void historyUpgrade(struct history_map* map, const struct history_header* header, const char* old)
+{
+    const struct history_slot_v1* slots = (const struct history_slot_v1*) (old + sizeof(struct history_header));
+    const char* data = (const char*) (slots + header->slot_count);
+    uint64_t count = header->next_seq;
+    uint64_t next_byte = header->next_byte;
+    char* command = malloc(map->header->data_size / 4 + 1);
+
+    for (uint64_t seq = count < header->slot_count ? 0 : count - header->slot_count; command != NULL && seq < count; seq++)
+    {
+        const struct history_slot_v1* slot = &slots[seq % header->slot_count];
+        if (slot->seq != seq + 1 || (slot->flags & HISTORY_ERASED) || slot->length > map->header->data_size / 4 ||
+            next_byte > slot->offset + header->data_size)
+        {
+            continue;
+        }
+
+        size_t pos = slot->offset % header->data_size;
+        size_t first = header->data_size - pos < slot->length ? header->data_size - pos : slot->length;
+        memcpy(command, data + pos, first);
+        memcpy(command + first, data, slot->length - first);
+
+        struct history_stats stats = { slot->timestamp, 0, 0, -1 };
+        historyMapAppend(map, command, slot->length, &stats);
+    }
+
+    free(command);
+}
+
+static ssize_t historyMapGet(struct history_map* map, uint64_t seq, char** buf, size_t* cap, struct history_stats* stats)
+{
+    if (seq < historyMapFirst(map))
+    {
+        return -1;
+    }
+
+    struct history_slot* slot = &map->slots[seq % map->header->slot_count];
+    uint64_t committed = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    uint32_t flags = atomic_load_explicit(&slot->flags, memory_order_acquire);
+    if (committed != seq + 1 || (flags & HISTORY_ERASED))
+    {
+        return -1;
+    }
+
+    uint64_t offset = slot->offset;
+    size_t length = slot->length;
+
+    // The statistics are written before the finished flag is set, so acquiring the flag makes them safe to read.
+    struct history_stats read_stats = { slot->timestamp, 0, 0, -1 };
+    if (flags & HISTORY_FINISHED)
+    {
+        read_stats.duration_us = slot->duration_us;
+        read_stats.cpu_us = slot->cpu_us;
+        read_stats.status = slot->status;
+    }
+
+    if (length > map->header->data_size)
+    {
+        return -1;
+    }
+
+    if (*buf == NULL || *cap < length + 1)
+    {
+        char* grown = realloc(*buf, length + 1);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        *buf = grown;
+        *cap = length + 1;
+    }
+
+    historyCopyOut(map, offset, *buf, length);
+
+    /**
+     * Like a seqlock, the copy only counts if the slot wasn't reused while we were
+     * reading it and no writer has lapped the data ring over our text since.
+     */
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != committed)
+    {
+        return -1;
+    }
+    if (atomic_load_explicit(&map->header->next_byte, memory_order_relaxed) > offset + map->header->data_size)
+    {
+        return -1;
+    }
+
+    (*buf)[length] = '\0';
+    if (stats != NULL)
+    {
+        *stats = read_stats;
+    }
+
+    return length;
+}
+
+/**
+ * Makes fresh the map we read and append to. The old one is only kept if our
+ * own worker is still compacting it, nothing else reads it after the switch.
+ */
+static void historySwitch(struct history_map* fresh)
+{
+    // The worker compacts the map it was given, which is the current one unless we already switched away from it.
+    if (atomic_load(&history_compacting) && retired.header == NULL)
+    {
+        retired = history;
+    }
+    else
+    {
+        historyUnmap(&history);
+    }
+
+    history = *fresh;
+    history_generation++;
+    historyResetFingerprints();
+}
+
+// Claims a record of a compacted file for copying to the new one. Only the first caller gets it.
+static bool historyClaim(struct history_map* map, uint64_t seq)
+{
+    struct history_slot* slot = &map->slots[seq % map->header->slot_count];
+    return !(atomic_fetch_or(&slot->flags, HISTORY_CLAIMED) & HISTORY_CLAIMED);
+}
+
+// Switches to the new file once another shell, or our own worker, has compacted the one we have mapped.
+static void historyCheckReplaced(void)
+{
+    if (retired.header != NULL && !atomic_load(&history_compacting))
+    {
+        historyUnmap(&retired);
+    }
+
+    if (history.header == NULL || atomic_load(&history.header->state) == HISTORY_LIVE)
+    {
+        return;
+    }
+
+    struct history_map fresh;
+    if (historyMapPath(history_path, &fresh) == -1)
+    {
+        return;
+    }
+    historySwitch(&fresh);
+}
+
+/**
+ * Finds the entry for a command's fingerprint. Returns the live entry with that
+ * hash if there is one, otherwise the first reusable entry along the probe chain.
+ */
+static struct hash_slot* historyFindFingerprint(uint64_t hash, uint64_t first)
+{
+    struct hash_slot* reusable = NULL;
+
+    for (struct hash_slot* entry = hashIndexFirst(&fingerprints, hash); ; entry = hashIndexNext(&fingerprints, entry))
+    {
+        if (entry->value == 0)
+        {
+            return reusable != NULL ? reusable : entry;
+        }
+
+        bool evicted = entry->value <= first;
+        if (!evicted && entry->hash == hash)
+        {
+            return entry;
+        }
+        if (evicted && reusable == NULL)
+        {
+            reusable = entry;
+        }
+    }
+}
+
+// Records seq as the newest copy of its command, erasing the copy it replaces.
+static void historyAddFingerprint(const char* command, size_t len, uint64_t seq, char** scratch, size_t* scratch_cap)
+{
+    uint64_t first = historyMapFirst(&history);
+    uint64_t hash = hashBytes(command, len);
+    struct hash_slot* entry = historyFindFingerprint(hash, first);
+
+    if (entry->value > first && entry->value - 1 != seq)
+    {
+        // Make sure it's really the same command and not just a hash collision.
+        uint64_t older = entry->value - 1;
+        if (historyMapGet(&history, older, scratch, scratch_cap, NULL) == len &&
+            memcmp(*scratch, command, len) == 0)
+        {
+            struct history_slot* slot = &history.slots[older % history.header->slot_count];
+            atomic_fetch_or(&slot->flags, HISTORY_ERASED);
+            atomic_fetch_add(&history.header->erased, 1);
+        }
+    }
+
+    if (entry->value == 0)
+    {
+        fingerprints.used++;
+    }
+    entry->hash = hash;
+    entry->value = seq + 1;
+}
+
+/**
+ * Brings the fingerprint set up to date with records appended since we last
+ * looked, including those written by other shells. The set is rebuilt from
+ * the live records once evicted entries start to clog it up.
+ */
+static void historySyncFingerprints(void)
+{
+    uint64_t first = historyMapFirst(&history);
+    uint64_t count = atomic_load_explicit(&history.header->next_seq, memory_order_acquire);
+    size_t slot_count = history.header->slot_count;
+
+    if (fingerprints.cap < slot_count * 2 || fingerprints.used > fingerprints.cap / 4 * 3)
+    {
+        // Without room for every live record the probe chains could fill up, so go without.
+        if (hashIndexReset(&fingerprints, slot_count) == -1)
+        {
+            hashIndexFree(&fingerprints);
+            return;
+        }
+        fingerprint_synced = 0;
+    }
+
+    size_t cap = 0;
+    size_t scratch_cap = 0;
+    char* command = NULL;
+    char* scratch = NULL;
+
+    for (uint64_t seq = fingerprint_synced > first ? fingerprint_synced : first; seq < count; seq++)
+    {
+        ssize_t len = historyMapGet(&history, seq, &command, &cap, NULL);
+        if (len != -1)
+        {
+            historyAddFingerprint(command, len, seq, &scratch, &scratch_cap);
+        }
+    }
+    fingerprint_synced = count;
+
+    free(command);
+    free(scratch);
+}
+
+/**
+ * Runs on the worker thread. Copies the live records into a new file, renames it
+ * over the old one, then marks the old one replaced so every shell switches over.
+ * Records appended to the old file while we were copying are migrated afterwards.
+ */
+static void historyCompact(void* arg)
+{
+    struct history_compaction* compaction = arg;
+    struct history_map* old = &compaction->old;
+    struct history_map fresh = { 0 };
+    char tmp_path[PATH_MAX + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.compact", history_path);
+
+    // The lock keeps several shells from compacting the same file at once.
+    int fd = open(history_path, O_RDWR);
+    int tmp_fd = -1;
+    struct stat st;
+    if (fd == -1 || flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &st) == -1 ||
+        st.st_ino != old->inode || atomic_load(&old->header->state) != HISTORY_LIVE)
+    {
+        goto done;
+    }
+
+    tmp_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (tmp_fd == -1)
+    {
+        perror("Could not create compacted history file! ");
+        goto done;
+    }
+
+    // Also lock the new file, so nobody compacts it before we have migrated the last records into it.
+    if (flock(tmp_fd, LOCK_EX) == -1 || historyInit(tmp_fd, compaction->slot_count) == -1 ||
+        historyMapFd(tmp_fd, &fresh) == -1)
+    {
+        unlink(tmp_path);
+        goto done;
+    }
+
+    size_t cap = 0;
+    char* command = NULL;
+    struct history_stats stats;
+    uint64_t count = atomic_load(&old->header->next_seq);
+
+    uint64_t first = historyMapFirst(old);
+    for (uint64_t seq = first; seq < count; seq++)
+    {
+        ssize_t len = historyMapGet(old, seq, &command, &cap, &stats);
+        if (len != -1 && len <= fresh.header->data_size / 4 && historyClaim(old, seq))
+        {
+            historyMapAppend(&fresh, command, len, &stats);
+        }
+    }
+
+    msync(fresh.header, fresh.size, MS_SYNC);
+    if (rename(tmp_path, history_path) == -1)
+    {
+        perror("Could not replace history file! ");
+        unlink(tmp_path);
+        free(command);
+
+        // The old file stays live, so the next compaction has to copy these again.
+        for (uint64_t seq = first; seq < count; seq++)
+        {
+            atomic_fetch_and(&old->slots[seq % old->header->slot_count].flags, ~HISTORY_CLAIMED);
+        }
+        goto done;
+    }
+
+    atomic_store(&old->header->state, HISTORY_REPLACED);
+
+    // Give writers that reserved a record just before the switch a moment to commit it.
+    uint64_t last;
+    do
+    {
+        last = atomic_load(&old->header->next_seq);
+        usleep(10000);
+    }
+    while (atomic_load(&old->header->next_seq) != last);
+
+    // Records that were still being written while we copied were skipped, so look again at everything not yet claimed.
+    for (uint64_t seq = first; seq < last; seq++)
+    {
+        if (atomic_load(&old->slots[seq % old->header->slot_count].flags) & HISTORY_CLAIMED)
+        {
+            continue;
+        }
+
+        ssize_t len = historyMapGet(old, seq, &command, &cap, &stats);
+        if (len != -1 && len <= fresh.header->data_size / 4 && historyClaim(old, seq))
+        {
+            historyMapAppend(&fresh, command, len, &stats);
+        }
+    }
+    free(command);
+
+    atomic_store(&old->header->migrated_to, last);
+    atomic_store(&old->header->state, HISTORY_MIGRATED);
+
+done:
+    historyUnmap(&fresh);
+    if (tmp_fd != -1)
+    {
+        close(tmp_fd);
+    }
+    if (fd != -1)
+    {
+        close(fd);
+    }
+    free(compaction);
+    atomic_store(&history_compacting, false);
+}
+
+static void historyMaybeCompact(void)
+{
+    uint64_t count = atomic_load(&history.header->next_seq);
+    uint64_t live = count - historyMapFirst(&history);
+    uint64_t erased = atomic_load(&history.header->erased);
+    // Only resize once, so shells started with different sizes don't keep resizing the file back and forth.
+    bool resize = !history_resized && history.header->slot_count != history_slots;
+
+    if (!resize && (erased < 64 || erased * 4 < live))
+    {
+        return;
+    }
+
+    bool idle = false;
+    if (!atomic_compare_exchange_strong(&history_compacting, &idle, true))
+    {
+        return;
+    }
+
+    // The last compaction is over, and the map it was given must not be mistaken for this one's.
+    historyUnmap(&retired);
+
+    struct history_compaction* compaction = malloc(sizeof(struct history_compaction));
+    if (compaction == NULL)
+    {
+        atomic_store(&history_compacting, false);
+        return;
+    }
+    compaction->old = history;
+    compaction->slot_count = resize ? history_slots : history.header->slot_count;
+    if (workerSubmit(historyCompact, compaction) == -1)
+    {
+        free(compaction);
+        atomic_store(&history_compacting, false);
+        return;
+    }
+    history_resized = history_resized || resize;
+}
+
+uint64_t historyAppend(const char* command, size_t len)
+{
+    historyCheckReplaced();
+
+    // Anything bigger than a quarter of the ring would evict too much of everyone else's history.
+    if (history.header == NULL || len > history.header->data_size / 4)
+    {
+        return historyCount();
+    }
+
+    struct history_stats stats = { time(NULL), 0, 0, -1 };
+    historySyncFingerprints();
+    uint64_t seq = historyMapAppend(&history, command, len, &stats);
+
+    if (atomic_load(&history.header->state) != HISTORY_LIVE)
+    {
+        /**
+         * The file was compacted while we were appending. Whichever of us and the
+         * compaction claims the record copies it, so unless the compaction already
+         * has, append it to the new file ourselves instead of waiting for it.
+         */
+        struct history_map fresh;
+        if (historyMapPath(history_path, &fresh) == -1)
+        {
+            return seq;
+        }
+
+        bool claimed = historyClaim(&history, seq);
+        historySwitch(&fresh);
+        if (claimed && len <= history.header->data_size / 4)
+        {
+            historySyncFingerprints();
+            seq = historyMapAppend(&history, command, len, &stats);
+        }
+        return seq;
+    }
+
+    if (fingerprints.slots != NULL)
+    {
+        size_t scratch_cap = 0;
+        char* scratch = NULL;
+
+        historyAddFingerprint(command, len, seq, &scratch, &scratch_cap);
+        free(scratch);
+    }
+
+    historyMaybeCompact();
+    return seq;
+}
+
+void historyFinish(uint64_t seq, const char* command, size_t len, const struct history_stats* stats)
+{
+    historyCheckReplaced();
+    if (history.header == NULL)
+    {
+        return;
+    }
+
+    size_t cap = 0;
+    char* text = NULL;
+    bool found = historyMapGet(&history, seq, &text, &cap, NULL) == len && memcmp(text, command, len) == 0;
+
+    // The records were renumbered by a compaction since, the fingerprint set knows where the command went.
+    if (!found)
+    {
+        historySyncFingerprints();
+        uint64_t first = historyMapFirst(&history);
+        if (fingerprints.slots != NULL)
+        {
+            struct hash_slot* entry = historyFindFingerprint(hashBytes(command, len), first);
+            if (entry->value > first)
+            {
+                seq = entry->value - 1;
+                found = historyMapGet(&history, seq, &text, &cap, NULL) == len && memcmp(text, command, len) == 0;
+            }
+        }
+    }
+    free(text);
+
+    if (!found)
+    {
+        return;
+    }
+
+    struct history_slot* slot = &history.slots[seq % history.header->slot_count];
+    slot->duration_us = stats->duration_us;
+    slot->cpu_us = stats->cpu_us;
+    slot->status = stats->status;
+    atomic_fetch_or_explicit(&slot->flags, HISTORY_FINISHED, memory_order_release);
+}
+
+uint64_t historyCount(void)
+{
+    historyCheckReplaced();
+    if (history.header == NULL)
+    {
+        return 0;
+    }
+    return atomic_load_explicit(&history.header->next_seq, memory_order_acquire);
+}
+
+uint64_t historyFirst(void)
+{
+    historyCheckReplaced();
+    if (history.header == NULL)
+    {
+        return 0;
+    }
+    return historyMapFirst(&history);
+}
+
+uint64_t historyGeneration(void)
+{
+    historyCheckReplaced();
+    return history_generation;
+}
+
+ssize_t historyGet(uint64_t seq, char** buf, size_t* cap, struct history_stats* stats)
+{
+    historyCheckReplaced();
+    if (history.header == NULL || seq >= historyCount())
+    {
+        return -1;
+    }
+    return historyMapGet(&history, seq, buf, cap, stats);
+}
@@ -0,0 +1,122 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+#define HISTORY_MAGIC 0x53494845454e4f42ULL
+#define HISTORY_VERSION 2
+
+// Default number of records kept, overridden with the BOONE_HISTSIZE environment variable.
+#define HISTORY_SLOTS 65536
+#define HISTORY_MIN_SLOTS 16
+
+// The data ring is sized from the slot count assuming commands average this many bytes.
+#define HISTORY_AVG_RECORD 128
+
+// Set on a slot once a newer copy of the same command has been appended.
+#define HISTORY_ERASED 1
+
+// Set on a slot once the command has finished and its run statistics are filled in.
+#define HISTORY_FINISHED 2
+
+// Set on a slot of a compacted file by whoever copies it to the new file, the compaction or the shell that appended it.
+#define HISTORY_CLAIMED 4
+
+// States of a history file, stored in its header.
+#define HISTORY_LIVE 0
+#define HISTORY_REPLACED 1
+#define HISTORY_MIGRATED 2
+
+/**
+ * The history file is a fixed size ring shared between every running shell
+ * through mmap. It is laid out as a header, an array of record slots and a
+ * data ring holding the command text. Writers reserve a sequence number and
+ * a range of data bytes with atomic adds, so no locks are ever taken.
+ *
+ * Repeated commands only keep their newest copy, older ones are marked erased.
+ * Once enough records are erased a background compaction writes the live ones
+ * to a new file and renames it over the old one. The old file is then marked
+ * replaced, which tells every shell mapping it to switch over.
+ */
+struct history_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint64_t data_size;
+
+    // Next record sequence number to hand out.
+    _Atomic uint64_t next_seq;
+
+    // Next byte to hand out in the data ring. Never wraps, the ring position is taken modulo data_size.
+    _Atomic uint64_t next_byte;
+
+    _Atomic uint32_t state;
+    uint32_t padding;
+
+    // Once migrated, records from this sequence number on were appended too late for the compaction to copy.
+    _Atomic uint64_t migrated_to;
+
+    _Atomic uint64_t erased;
+};
+
+struct history_slot
+{
+    // Holds the record's sequence number + 1 once it is committed, 0 while it is being written.
+    _Atomic uint64_t seq;
+    uint64_t offset;
+    uint32_t length;
+    _Atomic uint32_t flags;
+    int64_t timestamp;
+
+    // Only valid once HISTORY_FINISHED is set.
+    uint64_t duration_us;
+    uint64_t cpu_us;
+    int32_t status;
+    uint32_t padding;
+};
+
+// How a command ran. The status is the exit code, 128 + the signal number if it was killed, or -1 until it finishes.
+struct history_stats
+{
+    int64_t timestamp;
+    uint64_t duration_us;
+    uint64_t cpu_us;
+    int32_t status;
+};
+
+// Maps the history file at path, creating it if needed. Returns 1 if it was created, 0 if it existed and -1 on error.
+int historyOpen(const char* path);
+void historyClose(void);
+
+// Copies the lines of an old plain text history file into the ring.
+void historyImport(const char* path);
+
+// Appends a command to the ring, erasing any older copy of it, and returns its sequence number.
+uint64_t historyAppend(const char* command, size_t len);
+
+/**
+ * Records how the command appended as seq ran. If a compaction has renumbered the records
+ * since, the command's text is used to find its live copy instead.
+ */
+void historyFinish(uint64_t seq, const char* command, size_t len, const struct history_stats* stats);
+
+// Returns the sequence number the next appended record will get.
+uint64_t historyCount(void);
+
+// Returns the oldest sequence number that might still be readable.
+uint64_t historyFirst(void);
+
+// Bumped every time the shell switches to a compacted file, which renumbers every record.
+uint64_t historyGeneration(void);
+
+/**
+ * Copies the record with the given sequence number into *buf, growing it as needed, and its
+ * statistics into stats if it isn't NULL. Returns the length of the command, or -1 if the
+ * record was erased, overwritten or never committed.
+ */
+ssize_t historyGet(uint64_t seq, char** buf, size_t* cap, struct history_stats* stats);
+
+#endif
@@ -0,0 +1,271 @@
+#include "jobs.h"
+#include "event.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+
+struct job jobs[JOB_MAX];
+
+// SIGCHLD writes a byte to this pipe, which wakes the event loop up to reap.
+static int jobs_pipe[2] = { -1, -1 };
+static unsigned long jobs_stop_order = 0;
+
+static void jobsSignal(int sig)
+{
+    int saved_errno = errno;
+    write(jobs_pipe[1], "", 1);
+    errno = saved_errno;
+}
+
+static void jobsReady(int fd, void* data)
+{
+    jobsReap();
+
+    // Whatever waits on the foreground job gets another look at it.
+    eventRequestRefresh();
+}
+
+void jobsInit(void)
+{
+    if (pipe2(jobs_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+    {
+        perror("Could not create child signal pipe! ");
+        return;
+    }
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = jobsSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGCHLD, &action, NULL) == -1)
+    {
+        perror("Could not handle SIGCHLD! ");
+        return;
+    }
+
+    eventAdd(jobs_pipe[0], jobsReady, NULL);
+}
+
+struct job* jobAdd(pid_t pid, char** argv)
+{
+    for (int i = 0; i < JOB_MAX; i++)
+    {
+        if (jobs[i].state != JOB_FREE)
+        {
+            continue;
+        }
+
+        struct job* job = &jobs[i];
+        memset(job, 0, sizeof(struct job));
+        job->state = JOB_RUNNING;
+        job->pid = pid;
+        job->output_fd = -1;
+        clock_gettime(CLOCK_MONOTONIC, &job->start);
+
+        size_t len = 0;
+        for (int j = 0; argv[j] != NULL; j++)
+        {
+            len += strlen(argv[j]) + 1;
+        }
+
+        job->command = malloc(len + 1);
+        if (job->command != NULL)
+        {
+            char* end = job->command;
+            for (int j = 0; argv[j] != NULL; j++)
+            {
+                size_t arg_len = strlen(argv[j]);
+                memcpy(end, argv[j], arg_len);
+                end += arg_len;
+                *end++ = ' ';
+            }
+            *(end > job->command ? end - 1 : end) = '\0';
+        }
+
+        return job;
+    }
+
+    return NULL;
+}
+
+void jobFree(struct job* job)
+{
+    jobCancelTimer(job);
+    free(job->command);
+    free(job->history_line);
+    free(job->output_line);
+    memset(job, 0, sizeof(struct job));
+}
+
+void jobStop(struct job* job)
+{
+    if (job->state != JOB_STOPPED)
+    {
+        job->state = JOB_STOPPED;
+        job->stop_order = ++jobs_stop_order;
+    }
+}
+
+struct job* jobFind(pid_t pid)
+{
+    for (int i = 0; i < JOB_MAX; i++)
+    {
+        if (jobs[i].state != JOB_FREE && jobs[i].pid == pid)
+        {
+            return &jobs[i];
+        }
+    }
+    return NULL;
+}
+
+struct job* jobLastStopped(void)
+{
+    struct job* last = NULL;
+    for (int i = 0; i < JOB_MAX; i++)
+    {
+        if (jobs[i].state == JOB_STOPPED && (last == NULL || jobs[i].stop_order > last->stop_order))
+        {
+            last = &jobs[i];
+        }
+    }
+    return last;
+}
+
+int jobId(struct job* job)
+{
+    return job - jobs;
+}
+
+void jobsReap(void)
+{
+    char drain[64];
+    while (read(jobs_pipe[0], drain, sizeof(drain)) > 0);
+
+    int status;
+    pid_t pid;
+    struct rusage usage;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED | WCONTINUED, &usage)) > 0)
+    {
+        struct job* job = jobFind(pid);
+        if (job == NULL)
+        {
+            continue;
+        }
+
+        if (WIFSTOPPED(status))
+        {
+            jobStop(job);
+        }
+        else if (WIFCONTINUED(status))
+        {
+            job->state = JOB_RUNNING;
+        }
+        else
+        {
+            traceEvent(TRACE_CHILD_EXIT, pid);
+            jobCancelTimer(job);
+            job->state = JOB_DONE;
+            job->status = status;
+
+            clock_gettime(CLOCK_MONOTONIC, &job->end);
+            job->cpu_us = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000ULL +
+                          usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+        }
+    }
+}
+
+static int jobArmTimer(int fd, uint64_t ns)
+{
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+    when.it_value.tv_sec = ns / 1000000000ULL;
+    when.it_value.tv_nsec = ns % 1000000000ULL;
+
+    // A zero it_value would disarm the timer instead of firing it right away.
+    if (ns == 0)
+    {
+        when.it_value.tv_nsec = 1;
+    }
+
+    return timerfd_settime(fd, 0, &when, NULL);
+}
+
+static void jobTimerFired(int fd, void* data)
+{
+    struct job* job = data;
+    uint64_t expirations;
+    read(fd, &expirations, sizeof(expirations));
+
+    if (!job->timer_armed || job->state == JOB_FREE || job->state == JOB_DONE)
+    {
+        return;
+    }
+
+    if (!job->timer_escalated)
+    {
+        kill(job->pid, job->timer_signal);
+
+        // A stopped job would never act on the signal.
+        kill(job->pid, SIGCONT);
+
+        if (job->timer_grace_ns > 0 && job->timer_signal != SIGKILL)
+        {
+            job->timer_escalated = true;
+            jobArmTimer(fd, job->timer_grace_ns);
+            return;
+        }
+    }
+    else
+    {
+        kill(job->pid, SIGKILL);
+    }
+
+    jobCancelTimer(job);
+}
+
+int jobSetTimer(struct job* job, uint64_t timeout_ns, int sig, uint64_t grace_ns)
+{
+    jobCancelTimer(job);
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd == -1)
+    {
+        perror("Could not create timer! ");
+        return -1;
+    }
+
+    if (jobArmTimer(fd, timeout_ns) == -1 || eventAdd(fd, jobTimerFired, job) == -1)
+    {
+        perror("Could not arm timer! ");
+        close(fd);
+        return -1;
+    }
+
+    job->timer_armed = true;
+    job->timer_escalated = false;
+    job->timer_fd = fd;
+    job->timer_signal = sig;
+    job->timer_grace_ns = grace_ns;
+    return 0;
+}
+
+void jobCancelTimer(struct job* job)
+{
+    if (job->timer_armed)
+    {
+        eventRemove(job->timer_fd);
+        close(job->timer_fd);
+        job->timer_armed = false;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#define JOB_MAX 1024
+
+enum job_states
+{
+    JOB_FREE,
+    JOB_RUNNING,
+    JOB_STOPPED,
+
+    // Reaped, waiting for whoever launched it to collect the status and free the entry.
+    JOB_DONE
+};
+
+struct job
+{
+    int state;
+    pid_t pid;
+
+    // Wait status, valid once the job is done.
+    int status;
+
+    char* command;
+    struct timespec start;
+
+    // When it was reaped and the cpu time it used, from wait4.
+    struct timespec end;
+    uint64_t cpu_us;
+
+    // The history record of the command line that started the job as its sequence number + 1, 0 if none.
+    uint64_t history_seq;
+    char* history_line;
+
+    // Started with a trailing &, so it's reported and freed at the prompt once done instead of by whoever waits on it.
+    bool background;
+
+    /**
+     * Read end of the pipe carrying a background job's output when it gets prefixed,
+     * -1 otherwise. The last line read is kept here until its newline arrives.
+     */
+    int output_fd;
+    char* output_line;
+    size_t output_len;
+    size_t output_cap;
+
+    // Orders stopped jobs so fg resumes the most recently stopped one.
+    unsigned long stop_order;
+
+    /**
+     * Watchdog timer, a timerfd serviced by the event loop. When it fires the job
+     * gets timer_signal, and SIGKILL once the grace period runs out as well.
+     */
+    bool timer_armed;
+    bool timer_escalated;
+    int timer_fd;
+    int timer_signal;
+    uint64_t timer_grace_ns;
+};
+
+extern struct job jobs[JOB_MAX];
+
+// Installs the SIGCHLD handler and hooks child reaping into the event loop.
+void jobsInit(void);
+
+// Adds a running child to the table, remembering argv as its command. Returns NULL if the table is full.
+struct job* jobAdd(pid_t pid, char** argv);
+void jobFree(struct job* job);
+void jobStop(struct job* job);
+
+struct job* jobFind(pid_t pid);
+struct job* jobLastStopped(void);
+int jobId(struct job* job);
+
+/**
+ * Arms the job's watchdog to send sig after timeout_ns, then SIGKILL after another
+ * grace_ns unless grace_ns is 0. Replaces any watchdog already armed. Returns -1 on error.
+ */
+int jobSetTimer(struct job* job, uint64_t timeout_ns, int sig, uint64_t grace_ns);
+void jobCancelTimer(struct job* job);
+
+// Reaps every child that exited, stopped or continued and updates its job.
+void jobsReap(void);
+
+#endif
@@ -0,0 +1,588 @@
+#include "boone.h"
+
+#include <limits.h>
+#include <time.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+struct jump_entry
+{
+    char* path;
+    size_t len;
+    uint64_t hash;
+    double rank;
+    int64_t time;
+};
+
+struct jump_patterns
+{
+    char** patterns;
+    bool ignore_case;
+};
+
+struct jump_name
+{
+    const char* name;
+    size_t len;
+};
+
+struct jump_listed
+{
+    double score;
+    const char* path;
+};
+
+static struct jump_entry* entries = NULL;
+static size_t entry_count = 0;
+static size_t entry_cap = 0;
+
+// Index of the entries by path, holding entry index + 1.
+static struct hash_index jump_index;
+
+static char jump_path[PATH_MAX];
+static ino_t jump_inode;
+
+// How much of the file has been applied, how many records that was and the ranks they added up to.
+static off_t jump_synced = 0;
+static size_t jump_records = 0;
+static double jump_total = 0;
+
+static struct jump_entry* jumpLookup(const char* path, size_t len, uint64_t hash)
+{
+    struct hash_slot* slot = hashIndexFirst(&jump_index, hash);
+    for (; slot != NULL && slot->value != 0; slot = hashIndexNext(&jump_index, slot))
+    {
+        struct jump_entry* entry = &entries[slot->value - 1];
+        if (slot->hash == hash && entry->len == len && memcmp(entry->path, path, len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static int jumpRebuildIndex(void)
+{
+    if (hashIndexReset(&jump_index, entry_count) == -1)
+    {
+        return -1;
+    }
+
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        hashIndexInsert(&jump_index, entries[i].hash, i + 1);
+    }
+    return 0;
+}
+
+static void jumpReset(void)
+{
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        free(entries[i].path);
+    }
+    entry_count = 0;
+    jump_synced = 0;
+    jump_records = 0;
+    jump_total = 0;
+
+    hashIndexClear(&jump_index);
+}
+
+// Adds a visit, or a compacted directory's whole rank, to the entry for path.
+static void jumpApply(const char* path, size_t len, double rank, int64_t time)
+{
+    uint64_t hash = hashBytes(path, len);
+    struct jump_entry* entry = jumpLookup(path, len, hash);
+
+    if (entry == NULL)
+    {
+        if (entry_count == entry_cap)
+        {
+            size_t cap = entry_cap > 0 ? entry_cap * 2 : 64;
+            struct jump_entry* grown = realloc(entries, cap * sizeof(struct jump_entry));
+            if (grown == NULL)
+            {
+                return;
+            }
+            entries = grown;
+            entry_cap = cap;
+        }
+
+        entry = &entries[entry_count];
+        entry->path = strndup(path, len);
+        if (entry->path == NULL)
+        {
+            return;
+        }
+        entry->len = len;
+        entry->hash = hash;
+        entry->rank = 0;
+        entry->time = 0;
+        entry_count++;
+
+        if (entry_count * 2 + 2 > jump_index.cap)
+        {
+            jumpRebuildIndex();
+        }
+        else
+        {
+            hashIndexInsert(&jump_index, hash, entry_count);
+        }
+    }
+
+    entry->rank += rank;
+    entry->time = time > entry->time ? time : entry->time;
+    jump_total += rank;
+}
+
+static bool jumpValidHeader(int fd)
+{
+    struct jump_file_header header;
+    return pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+           header.magic == JUMP_MAGIC && header.version == JUMP_VERSION;
+}
+
+/**
+ * Applies the records appended since the last sync, or everything if the file
+ * was replaced by a compaction. The caller holds a lock on fd.
+ */
+static void jumpSyncFd(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        return;
+    }
+
+    if (st.st_ino != jump_inode || jump_synced == 0)
+    {
+        if (!jumpValidHeader(fd))
+        {
+            return;
+        }
+        jumpReset();
+        jump_inode = st.st_ino;
+        jump_synced = sizeof(struct jump_file_header);
+    }
+
+    if (st.st_size <= jump_synced)
+    {
+        return;
+    }
+
+    size_t size = st.st_size - jump_synced;
+    char* data = malloc(size);
+    if (data == NULL || pread(fd, data, size, jump_synced) != size)
+    {
+        free(data);
+        return;
+    }
+
+    // A record another shell is still writing is left for the next sync.
+    size_t pos = 0;
+    while (pos + sizeof(struct jump_record) <= size)
+    {
+        struct jump_record record;
+        memcpy(&record, data + pos, sizeof(record));
+        if (pos + sizeof(record) + record.length > size)
+        {
+            break;
+        }
+
+        jumpApply(data + pos + sizeof(record), record.length, record.rank, record.time);
+        pos += sizeof(record) + record.length;
+        jump_records++;
+    }
+    jump_synced += pos;
+
+    free(data);
+}
+
+static void jumpSync(void)
+{
+    int fd = open(jump_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    flock(fd, LOCK_SH);
+    jumpSyncFd(fd);
+    close(fd);
+}
+
+int jumpOpen(const char* path)
+{
+    snprintf(jump_path, sizeof(jump_path), "%s", path);
+
+    int fd = open(jump_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    struct stat st;
+    if (flock(fd, LOCK_EX) == -1 || fstat(fd, &st) == -1)
+    {
+        close(fd);
+        return -1;
+    }
+
+    if (st.st_size == 0)
+    {
+        struct jump_file_header header = { JUMP_MAGIC, JUMP_VERSION, 0 };
+        if (write(fd, &header, sizeof(header)) != sizeof(header))
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    else if (!jumpValidHeader(fd))
+    {
+        fprintf(stderr, "\r%s is not a jump file!\n", jump_path);
+        jump_path[0] = '\0';
+        close(fd);
+        return -1;
+    }
+
+    jumpSyncFd(fd);
+    close(fd);
+    return 0;
+}
+
+// Forgets directories with a rank below one, both those aged out and those jumpBest found missing.
+static void jumpForget(void)
+{
+    size_t kept = 0;
+    jump_total = 0;
+
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        if (entries[i].rank < 1)
+        {
+            free(entries[i].path);
+            continue;
+        }
+
+        entries[kept++] = entries[i];
+        jump_total += entries[i].rank;
+    }
+
+    entry_count = kept;
+    jumpRebuildIndex();
+}
+
+// Ages the ranks once they add up to too much.
+static void jumpAge(void)
+{
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        entries[i].rank *= JUMP_AGING;
+    }
+    jumpForget();
+}
+
+// Opens and locks the jump file, retrying if a compaction renamed a new one over it before the lock was taken.
+static int jumpOpenLocked(int flags, int operation)
+{
+    for (int attempt = 0; attempt < 3; attempt++)
+    {
+        int fd = open(jump_path, flags | O_CLOEXEC);
+        if (fd == -1)
+        {
+            return -1;
+        }
+
+        struct stat fd_st, path_st;
+        if (flock(fd, operation) == 0 && fstat(fd, &fd_st) == 0 && stat(jump_path, &path_st) == 0 &&
+            fd_st.st_ino == path_st.st_ino)
+        {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+/**
+ * Rewrites the log with one record per directory and renames it over the old one.
+ * The exclusive lock keeps other shells from appending to the file being replaced,
+ * they notice the new inode once they get their lock and append to it instead.
+ */
+static void jumpCompact(void)
+{
+    char tmp_path[PATH_MAX + 16];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.compact", jump_path);
+
+    int fd = jumpOpenLocked(O_RDONLY, LOCK_EX);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    // Another shell may have compacted or appended while we waited for the lock.
+    jumpSyncFd(fd);
+    if (jump_total > JUMP_MAX_RANK)
+    {
+        jumpAge();
+    }
+    else
+    {
+        jumpForget();
+    }
+
+    struct boone_output out = { 0 };
+    struct jump_file_header header = { JUMP_MAGIC, JUMP_VERSION, 0 };
+    outputWrite(&out, (const char*) &header, sizeof(header));
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        struct jump_record record = { entries[i].time, entries[i].rank, entries[i].len };
+        outputWrite(&out, (const char*) &record, sizeof(record));
+        outputWrite(&out, entries[i].path, entries[i].len);
+    }
+
+    int tmp_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    struct stat st;
+    if (tmp_fd == -1 || write(tmp_fd, out.data, out.len) != out.len || fdatasync(tmp_fd) == -1 ||
+        fstat(tmp_fd, &st) == -1 || rename(tmp_path, jump_path) == -1)
+    {
+        perror("Could not compact jump file! ");
+        unlink(tmp_path);
+    }
+    else
+    {
+        jump_inode = st.st_ino;
+        jump_synced = out.len;
+        jump_records = entry_count;
+    }
+
+    if (tmp_fd != -1)
+    {
+        close(tmp_fd);
+    }
+    outputFree(&out);
+    close(fd);
+}
+
+// Appends a visit record to the file. Returns -1 if it couldn't, the visit then only counts in memory.
+static int jumpAppend(const char* directory, size_t len, int64_t now)
+{
+    struct jump_record record = { now, 1, len };
+    char* buf = malloc(sizeof(record) + len);
+    if (buf == NULL || jump_path[0] == '\0')
+    {
+        free(buf);
+        return -1;
+    }
+    memcpy(buf, &record, sizeof(record));
+    memcpy(buf + sizeof(record), directory, len);
+
+    // O_APPEND keeps the records of shells appending at the same time from interleaving.
+    int result = -1;
+    int fd = jumpOpenLocked(O_WRONLY | O_APPEND, LOCK_SH);
+    if (fd != -1)
+    {
+        result = write(fd, buf, sizeof(record) + len) == sizeof(record) + len ? 0 : -1;
+        close(fd);
+    }
+
+    free(buf);
+    return result;
+}
+
+void jumpVisit(const char* directory)
+{
+    size_t len = strlen(directory);
+    int64_t now = time(NULL);
+
+    if (jumpAppend(directory, len, now) == 0)
+    {
+        jumpSync();
+    }
+    else
+    {
+        jumpApply(directory, len, 1, now);
+    }
+
+    if (jump_path[0] != '\0' && (jump_total > JUMP_MAX_RANK || jump_records > entry_count + JUMP_COMPACT_SLACK))
+    {
+        jumpCompact();
+    }
+}
+
+static double jumpFrecency(const struct jump_entry* entry, int64_t now)
+{
+    int64_t age = now - entry->time;
+    if (age < 60 * 60)
+    {
+        return entry->rank * 4;
+    }
+    if (age < 24 * 60 * 60)
+    {
+        return entry->rank * 2;
+    }
+    if (age < 7 * 24 * 60 * 60)
+    {
+        return entry->rank / 2;
+    }
+    return entry->rank / 4;
+}
+
+double jumpScore(const char* directory)
+{
+    size_t len = strlen(directory);
+    struct jump_entry* entry = jumpLookup(directory, len, hashBytes(directory, len));
+    return entry != NULL ? jumpFrecency(entry, time(NULL)) : 0;
+}
+
+/**
+ * Returns the highest scoring entry that matches, checking it still exists. Entries
+ * that don't get a rank of 0, which skips them until the next compaction drops them.
+ */
+static const char* jumpBest(bool (*matches)(const struct jump_entry*, const void*), const void* arg)
+{
+    int64_t now = time(NULL);
+
+    while (true)
+    {
+        struct jump_entry* best = NULL;
+        double best_score = 0;
+
+        for (size_t i = 0; i < entry_count; i++)
+        {
+            if (entries[i].rank <= 0 || !matches(&entries[i], arg))
+            {
+                continue;
+            }
+
+            double score = jumpFrecency(&entries[i], now);
+            if (score > best_score)
+            {
+                best = &entries[i];
+                best_score = score;
+            }
+        }
+
+        if (best == NULL)
+        {
+            return NULL;
+        }
+
+        struct stat st;
+        if (stat(best->path, &st) == 0 && S_ISDIR(st.st_mode))
+        {
+            return best->path;
+        }
+        jump_total -= best->rank;
+        best->rank = 0;
+    }
+}
+
+static bool jumpMatchesPatterns(const struct jump_entry* entry, const void* arg)
+{
+    const struct jump_patterns* match = arg;
+    const char* p = entry->path;
+
+    for (char** pattern = match->patterns; *pattern != NULL; pattern++)
+    {
+        const char* found = match->ignore_case ? strcasestr(p, *pattern) : strstr(p, *pattern);
+        if (found == NULL)
+        {
+            return false;
+        }
+        p = found + strlen(*pattern);
+    }
+    return true;
+}
+
+static bool jumpMatchesName(const struct jump_entry* entry, const void* arg)
+{
+    const struct jump_name* match = arg;
+    const char* name = strrchr(entry->path, '/');
+    return name != NULL && strncmp(name + 1, match->name, match->len) == 0;
+}
+
+const char* jumpFind(char** patterns)
+{
+    jumpSync();
+
+    // Patterns are case sensitive unless nothing matches them that way.
+    struct jump_patterns match = { patterns, false };
+    const char* best = jumpBest(jumpMatchesPatterns, &match);
+    if (best == NULL)
+    {
+        match.ignore_case = true;
+        best = jumpBest(jumpMatchesPatterns, &match);
+    }
+    return best;
+}
+
+const char* jumpComplete(const char* name, size_t len)
+{
+    struct jump_name match = { name, len };
+    return jumpBest(jumpMatchesName, &match);
+}
+
+static int jumpCompareListed(const void* a, const void* b)
+{
+    double score_a = ((const struct jump_listed*) a)->score;
+    double score_b = ((const struct jump_listed*) b)->score;
+    return score_a < score_b ? -1 : score_a > score_b;
+}
+
+// Lists every directory with its score, best last so it ends up next to the prompt.
+static void jumpList(void)
+{
+    jumpSync();
+
+    struct jump_listed* listed = malloc((entry_count + 1) * sizeof(struct jump_listed));
+    if (listed == NULL)
+    {
+        perror("Could not allocate! ");
+        return;
+    }
+
+    int64_t now = time(NULL);
+    size_t count = 0;
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        if (entries[i].rank > 0)
+        {
+            listed[count].score = jumpFrecency(&entries[i], now);
+            listed[count].path = entries[i].path;
+            count++;
+        }
+    }
+    qsort(listed, count, sizeof(struct jump_listed), jumpCompareListed);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        printf("\r%10.1f %s\n", listed[i].score, listed[i].path);
+    }
+    free(listed);
+}
+
+int shell_j(char** args)
+{
+    if (args[1] == NULL)
+    {
+        jumpList();
+        return 0;
+    }
+
+    const char* best = jumpFind(args + 1);
+    if (best == NULL)
+    {
+        fprintf(stderr, "\rNo visited directory matches %s!\n", args[1]);
+        return 1;
+    }
+
+    // Going through cd records the visit and updates the prompt like any other cd.
+    char* path = strdup(best);
+    char* cd_args[] = { "cd", path, NULL };
+    int result = shell_cd(cd_args);
+    free(path);
+
+    return result;
+}
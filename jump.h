@@ -0,0 +1,60 @@
+#ifndef JUMP_H
+#define JUMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JUMP_MAGIC 0x504d554a454e4f42ULL
+#define JUMP_VERSION 1
+
+// Once the ranks add up to this much they are all aged, so directories that stopped being visited fade out.
+#define JUMP_MAX_RANK 9000
+#define JUMP_AGING 0.9
+
+// The log is compacted once it holds this many records more than there are directories.
+#define JUMP_COMPACT_SLACK 1024
+
+/**
+ * The jump file is an append-only log of directory visits shared by every
+ * running shell. Each cd appends one small record, and loading the file adds
+ * the records of each directory up into its rank. Once the log has grown well
+ * past the number of directories it is rewritten with one record per
+ * directory holding its aged rank, and renamed over the old one.
+ */
+struct jump_file_header
+{
+    uint64_t magic;
+    uint32_t version;
+    uint32_t padding;
+};
+
+// Followed by length bytes of the path, without a terminating '\0'.
+struct jump_record
+{
+    int64_t time;
+    float rank;
+    uint32_t length;
+};
+
+// Loads the jump file at path, creating it if needed. Returns -1 on error.
+int jumpOpen(const char* path);
+
+// Records a visit to an absolute directory path.
+void jumpVisit(const char* directory);
+
+// Frecency of a directory, its rank weighted by how recently it was visited. 0 if it was never visited.
+double jumpScore(const char* directory);
+
+/**
+ * Returns the highest scoring directory containing every pattern, in order,
+ * or NULL if there is none. Directories that no longer exist are skipped.
+ */
+const char* jumpFind(char** patterns);
+
+// Returns the highest scoring directory whose last component starts with the len bytes of name, or NULL.
+const char* jumpComplete(const char* name, size_t len);
+
+// Jumps to the best match for the patterns, or lists the index without any.
+int shell_j(char** args);
+
+#endif
@@ -0,0 +1,358 @@
+#include "boone.h"
+
+#include <sys/mman.h>
+
+/**
+ * Arguments are built in one growable buffer as NUL terminated words. Only their
+ * start offsets are recorded while it grows, they become pointers at the end.
+ */
+struct lexer_words
+{
+    struct boone_output text;
+    size_t* starts;
+    int count;
+    int cap;
+    bool in_word;
+};
+
+struct lexer_capture
+{
+    struct boone_output* out;
+    bool eof;
+};
+
+static int lexerStartWord(struct lexer_words* words, size_t start)
+{
+    if (words->count == words->cap)
+    {
+        int cap = words->cap > 0 ? words->cap * 2 : USER_ARG_SIZE;
+        size_t* grown = realloc(words->starts, cap * sizeof(size_t));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        words->starts = grown;
+        words->cap = cap;
+    }
+
+    words->starts[words->count++] = start;
+    words->in_word = true;
+    return 0;
+}
+
+static int lexerEndWord(struct lexer_words* words)
+{
+    if (!words->in_word)
+    {
+        return 0;
+    }
+
+    words->in_word = false;
+    return outputWrite(&words->text, "", 1);
+}
+
+// Splits everything appended to the buffer since from into words, in place.
+static int lexerSplit(struct lexer_words* words, size_t from)
+{
+    for (size_t i = from; i < words->text.len; i++)
+    {
+        char c = words->text.data[i];
+        if (isspace((unsigned char)c) || c == '\0')
+        {
+            words->text.data[i] = '\0';
+            words->in_word = false;
+        }
+        else if (!words->in_word && lexerStartWord(words, i) == -1)
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// True if p starts a $(...), ${NAME} or $NAME.
+static bool lexerStartsExpansion(const char* p)
+{
+    return p[0] == '$' && (p[1] == '(' || p[1] == '{' || varsNameLength(p + 1) > 0);
+}
+
+// Returns the parenthesis closing the one at open, or NULL if there isn't one.
+static char* lexerClosingParen(char* open)
+{
+    int depth = 0;
+    for (char* p = open; *p != '\0'; p++)
+    {
+        if (*p == '(')
+        {
+            depth++;
+        }
+        else if (*p == ')' && --depth == 0)
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static char** lexerFinish(struct lexer_words* words)
+{
+    char** argv = malloc((words->count + 1) * sizeof(char*) + words->text.len + 1);
+    if (argv != NULL)
+    {
+        char* text = (char*)(argv + words->count + 1);
+        if (words->text.len > 0)
+        {
+            memcpy(text, words->text.data, words->text.len);
+        }
+
+        for (int i = 0; i < words->count; i++)
+        {
+            argv[i] = text + words->starts[i];
+        }
+        argv[words->count] = NULL;
+    }
+
+    outputFree(&words->text);
+    free(words->starts);
+    return argv;
+}
+
+static char** lexerUnterminated(struct lexer_words* words, const char* what)
+{
+    fprintf(stderr, "\rUnterminated %s in command!\n", what);
+    words->count = 0;
+    free(lexerFinish(words));
+    return NULL;
+}
+
+char** lexerExpand(char* command)
+{
+    struct lexer_words words;
+    memset(&words, 0, sizeof(words));
+
+    for (char* p = command; *p != '\0'; p++)
+    {
+        if (p[0] == '$' && p[1] == '(')
+        {
+            char* close = lexerClosingParen(p + 1);
+            if (close == NULL)
+            {
+                return lexerUnterminated(&words, "$(");
+            }
+
+            *close = '\0';
+            size_t from = words.text.len;
+            lexerCapture(p + 2, &words.text);
+
+            // Like other shells, trailing newlines don't end the word the output is glued to.
+            while (words.text.len > from)
+            {
+                char last = words.text.data[words.text.len - 1];
+                if (last != '\n' && last != '\r')
+                {
+                    break;
+                }
+                words.text.data[--words.text.len] = '\0';
+            }
+            lexerSplit(&words, from);
+            p = close;
+            continue;
+        }
+
+        if (lexerStartsExpansion(p))
+        {
+            const char* name = p + 1;
+            size_t len = varsNameLength(name);
+            char* last = p + len;
+            if (p[1] == '{')
+            {
+                last = strchr(p + 2, '}');
+                if (last == NULL)
+                {
+                    return lexerUnterminated(&words, "${");
+                }
+                name = p + 2;
+                len = last - name;
+            }
+
+            // The value is split into arguments just like the output of a substitution.
+            const char* value = varsGet(name, len);
+            if (value != NULL)
+            {
+                size_t from = words.text.len;
+                outputWrite(&words.text, value, strlen(value));
+                lexerSplit(&words, from);
+            }
+            p = last;
+            continue;
+        }
+
+        if (strchr(DELIMETERS, *p) != NULL)
+        {
+            lexerEndWord(&words);
+            continue;
+        }
+
+        // Copy the rest of the word in one go, up to a delimiter or the next expansion.
+        size_t len = 1 + strcspn(p + 1, DELIMETERS "$");
+        while (p[len] == '$' && !lexerStartsExpansion(p + len))
+        {
+            len += 1 + strcspn(p + len + 1, DELIMETERS "$");
+        }
+
+        if (!words.in_word)
+        {
+            lexerStartWord(&words, words.text.len);
+        }
+        outputWrite(&words.text, p, len);
+        p += len - 1;
+    }
+    lexerEndWord(&words);
+
+    return lexerFinish(&words);
+}
+
+static void lexerCaptureReadable(int fd, void* data)
+{
+    struct lexer_capture* capture = data;
+    struct boone_output* out = capture->out;
+
+    if (outputReserve(out, LEXER_READ_CHUNK) == 0)
+    {
+        ssize_t nread = read(fd, out->data + out->len, LEXER_READ_CHUNK);
+        if (nread > 0)
+        {
+            out->len += nread;
+            out->data[out->len] = '\0';
+            return;
+        }
+        if (nread == -1 && (errno == EINTR || errno == EAGAIN))
+        {
+            return;
+        }
+    }
+
+    // End of output, or we ran out of memory for it.
+    capture->eof = true;
+    eventRemove(fd);
+    eventRequestRefresh();
+}
+
+// Appends whatever the shell's own builtins printed to the memfd standing in for stdout.
+static void lexerCaptureBuiltin(int memfd, struct boone_output* out)
+{
+    off_t size = lseek(memfd, 0, SEEK_END);
+    if (size <= 0 || outputReserve(out, size) == -1)
+    {
+        return;
+    }
+
+    ssize_t nread = pread(memfd, out->data + out->len, size, 0);
+    if (nread > 0)
+    {
+        out->len += nread;
+        out->data[out->len] = '\0';
+    }
+}
+
+int lexerCapture(char* command, struct boone_output* out)
+{
+    char** argv = lexerExpand(command);
+    if (argv == NULL || argv[0] == NULL)
+    {
+        free(argv);
+        return 0;
+    }
+
+    // Plugin builtins already write into a buffer, so they can write into ours.
+    boone_builtin plugin = pluginFind(argv[0]);
+    if (plugin != NULL)
+    {
+        plugin(argv, out);
+        free(argv);
+        return 0;
+    }
+
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) == -1)
+    {
+        perror("Could not create capture pipe! ");
+        free(argv);
+        return -1;
+    }
+
+    int memfd = memfd_create("boone-capture", MFD_CLOEXEC);
+    int saved_stdout = dup(STDOUT_FILENO);
+    if (memfd == -1 || saved_stdout == -1)
+    {
+        perror("Could not redirect builtin output! ");
+        close(pipe_fds[0]);
+        close(pipe_fds[1]);
+        if (memfd != -1)
+        {
+            close(memfd);
+        }
+        free(argv);
+        return -1;
+    }
+
+    struct lexer_capture capture = { out, false };
+    eventAdd(pipe_fds[0], lexerCaptureReadable, &capture);
+
+    // Programs get the pipe through spawn_process, builtins print into the memfd.
+    fflush(stdout);
+    dup2(memfd, STDOUT_FILENO);
+    spawn_stdout = pipe_fds[1];
+
+    execute_process(argv);
+
+    spawn_stdout = -1;
+    fflush(stdout);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    close(pipe_fds[1]);
+
+    // Drain the pipe until every writer is gone and the program, if one was started, has exited.
+    struct job* job = child_pid != NO_CHILD_PID ? jobFind(child_pid) : NULL;
+    while (!capture.eof || (job != NULL && job->state != JOB_DONE))
+    {
+        if (!eventWaitInput())
+        {
+            continue;
+        }
+
+        // Stdin at end of file stays readable, so stop watching it rather than spin on it.
+        int typed = editorBufferTypeahead();
+        if (typed == -1)
+        {
+            eventWatchInput(false);
+        }
+        if (typed == 1)
+        {
+            if (job == NULL || job->state == JOB_DONE)
+            {
+                break;
+            }
+            kill(job->pid, SIGKILL);
+        }
+    }
+    eventWatchInput(true);
+
+    if (!capture.eof)
+    {
+        eventRemove(pipe_fds[0]);
+    }
+    close(pipe_fds[0]);
+
+    if (job != NULL)
+    {
+        jobFree(job);
+        child_pid = NO_CHILD_PID;
+    }
+
+    lexerCaptureBuiltin(memfd, out);
+    close(memfd);
+    free(argv);
+
+    return 0;
+}
@@ -0,0 +1,27 @@
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "plugin.h"
+
+#define LEXER_READ_CHUNK 65536
+
+/**
+ * Splits a command line into arguments like editorGetArgs, except every $(...)
+ * is run first and what it prints is split into arguments in its place, so
+ * `ls $(cat dirs)` works without an extra sh -c. Substitutions nest. $NAME and
+ * ${NAME} are replaced by the variable's value, split into arguments the same
+ * way, or by nothing if it isn't set.
+ *
+ * The arguments and their text share one allocation, so a single free releases
+ * them. command is modified. Returns NULL on a syntax error.
+ */
+char** lexerExpand(char* command);
+
+/**
+ * Runs command the way the shell would and appends everything it prints to out.
+ * Plugin builtins write straight into out, programs through a pipe drained by
+ * the event loop while they run.
+ */
+int lexerCapture(char* command, struct boone_output* out);
+
+#endif
@@ -0,0 +1,73 @@
+#include "boone.h"
+
+int main(int argc, char** argv, char** envp)
+{
+    atexit(disableModes);
+    atexit(historyClose);
+    jobsInit();
+    varsInit(envp);
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            if (traceOpen(argv[++i]) == -1)
+            {
+                return 1;
+            }
+            atexit(traceClose);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--trace FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    editorInitWindow();
+    tcgetattr(STDIN_FILENO, &orig_termios);
+    write(STDOUT_FILENO, "\x1b[2J", 4);
+    write(STDOUT_FILENO, "\x1b[H", 3);
+    getcwd(program_wd, sizeof(program_wd) - strlen("/history.db"));
+    strcat(program_wd, "/history.db");
+
+    int created = historyOpen(program_wd);
+    if (created == -1)
+    {
+        perror("Could not create / open file history.db at beginning! ");
+        return 1;
+    }
+
+    // Carry over the plain text history kept by older versions of the shell.
+    if (created == 1)
+    {
+        char legacy_path[256];
+        getcwd(legacy_path, sizeof(legacy_path) - strlen("/history.txt"));
+        strcat(legacy_path, "/history.txt");
+        historyImport(legacy_path);
+    }
+
+    // Directories visited with cd, ranked for j and cd completion.
+    char jump_path[256];
+    getcwd(jump_path, sizeof(jump_path) - strlen("/jump.db"));
+    strcat(jump_path, "/jump.db");
+    if (jumpOpen(jump_path) == -1)
+    {
+        perror("Could not open file jump.db! ");
+    }
+
+    editor_state.history_max = historyCount();
+    editor_state.history_pos = editor_state.history_max;
+
+    while (true)
+    {
+        char** user_args = read_user_line();
+
+        if (user_args != NULL && execute_command_line(user_args) == 1)
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,325 @@
+#include "boone.h"
+
+#include <time.h>
+
+#define PARALLEL_MARKER ":::"
+#define PARALLEL_PLACEHOLDER "{}"
+
+struct parallel_summary
+{
+    int launched;
+    int failed;
+
+    // Count of jobs per exit code, with signals counted as 128 + the signal number.
+    int codes[256];
+};
+
+// Reads one input per line until EOF, in cooked mode so the user can type them and end with Ctrl-D.
+static char** parallelReadInputs(int* count)
+{
+    int cap = USER_ARG_SIZE;
+    char** inputs = malloc(cap * sizeof(char*));
+    size_t len = 0;
+    char* line = NULL;
+    ssize_t nread;
+
+    *count = 0;
+    if (inputs == NULL)
+    {
+        return NULL;
+    }
+
+    bool tty = isatty(STDIN_FILENO);
+    if (tty)
+    {
+        disableModes();
+    }
+
+    while ((nread = getline(&line, &len, stdin)) != -1)
+    {
+        if (nread > 0 && line[nread - 1] == '\n')
+        {
+            line[--nread] = '\0';
+        }
+        if (nread == 0)
+        {
+            continue;
+        }
+
+        if (*count + 1 >= cap)
+        {
+            cap *= 2;
+            char** grown = realloc(inputs, cap * sizeof(char*));
+            if (grown == NULL)
+            {
+                break;
+            }
+            inputs = grown;
+        }
+        inputs[(*count)++] = strdup(line);
+    }
+
+    free(line);
+    clearerr(stdin);
+    if (tty)
+    {
+        enableMonitorMode();
+    }
+
+    return inputs;
+}
+
+// Replaces every {} in arg with input. Returns a new string, or NULL if arg has no placeholder.
+static char* parallelSubstitute(const char* arg, const char* input)
+{
+    const char* found = strstr(arg, PARALLEL_PLACEHOLDER);
+    if (found == NULL)
+    {
+        return NULL;
+    }
+
+    size_t count = 0;
+    for (const char* p = found; p != NULL; p = strstr(p + 2, PARALLEL_PLACEHOLDER))
+    {
+        count++;
+    }
+
+    size_t input_len = strlen(input);
+    char* result = malloc(strlen(arg) + count * input_len + 1);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+
+    char* out = result;
+    const char* p = arg;
+    while ((found = strstr(p, PARALLEL_PLACEHOLDER)) != NULL)
+    {
+        memcpy(out, p, found - p);
+        out += found - p;
+        memcpy(out, input, input_len);
+        out += input_len;
+        p = found + 2;
+    }
+    strcpy(out, p);
+
+    return result;
+}
+
+/**
+ * Builds the command for one input and launches it. Inputs replace each {}
+ * or, if the command has none, are appended as the last argument.
+ */
+static struct job* parallelLaunch(char** command, int command_len, char* input)
+{
+    char** argv = malloc((command_len + 2) * sizeof(char*));
+    char** owned = malloc((command_len + 1) * sizeof(char*));
+    struct job* job = NULL;
+    bool substituted = false;
+
+    if (argv != NULL && owned != NULL)
+    {
+        for (int i = 0; i < command_len; i++)
+        {
+            owned[i] = parallelSubstitute(command[i], input);
+            argv[i] = owned[i] != NULL ? owned[i] : command[i];
+            substituted |= owned[i] != NULL;
+        }
+
+        argv[command_len] = substituted ? NULL : input;
+        argv[command_len + 1] = NULL;
+        job = spawn_process(argv, &background_policy);
+
+        for (int i = 0; i < command_len; i++)
+        {
+            free(owned[i]);
+        }
+    }
+
+    free(argv);
+    free(owned);
+    return job;
+}
+
+static void parallelCollect(struct job* job, struct parallel_summary* summary)
+{
+    int code = WIFEXITED(job->status) ? WEXITSTATUS(job->status) : 128 + WTERMSIG(job->status);
+    summary->codes[code & 0xff]++;
+    if (code != 0)
+    {
+        summary->failed++;
+    }
+    jobFree(job);
+}
+
+/**
+ * Sleeps in the event loop until SIGCHLD reaps something, so watchdog timers keep
+ * firing meanwhile. Ctrl-C kills everything still running. Returns false once cancelled.
+ */
+static bool parallelWait(struct job** running, int max_jobs)
+{
+    // A redraw request means the event loop reaped a child for us.
+    if (!eventWaitInput())
+    {
+        return true;
+    }
+
+    // Stdin at end of file stays readable, so stop watching it rather than spin on it.
+    int typed = editorBufferTypeahead();
+    if (typed == -1)
+    {
+        eventWatchInput(false);
+    }
+    if (typed != 1)
+    {
+        return true;
+    }
+
+    for (int i = 0; i < max_jobs; i++)
+    {
+        if (running[i] != NULL)
+        {
+            kill(running[i]->pid, SIGKILL);
+        }
+    }
+    return false;
+}
+
+int shell_parallel(char** args)
+{
+    long max_jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int argi = 1;
+
+    if (args[argi] != NULL && strcmp(args[argi], "-j") == 0 && args[argi + 1] != NULL)
+    {
+        max_jobs = strtol(args[argi + 1], NULL, 10);
+        argi += 2;
+    }
+    if (max_jobs < 1)
+    {
+        max_jobs = 1;
+    }
+    if (max_jobs > JOB_MAX / 2)
+    {
+        max_jobs = JOB_MAX / 2;
+    }
+
+    char** command = args + argi;
+    int command_len = 0;
+    while (command[command_len] != NULL && strcmp(command[command_len], PARALLEL_MARKER) != 0)
+    {
+        command_len++;
+    }
+
+    if (command_len == 0)
+    {
+        printf("\r%s\n", "Usage: parallel [-j N] command [{}]... [::: input...]");
+        return 1;
+    }
+
+    // Inputs follow the ::: marker, without one they are read from standard input.
+    char** inputs;
+    int input_count = 0;
+    bool owned_inputs = command[command_len] == NULL;
+
+    enableMonitorMode();
+    if (owned_inputs)
+    {
+        inputs = parallelReadInputs(&input_count);
+    }
+    else
+    {
+        inputs = command + command_len + 1;
+        while (inputs[input_count] != NULL)
+        {
+            input_count++;
+        }
+    }
+
+    struct job** running = calloc(max_jobs, sizeof(struct job*));
+    if (inputs == NULL || running == NULL)
+    {
+        perror("Could not allocate! ");
+        free(running);
+        return 1;
+    }
+
+    struct parallel_summary summary;
+    memset(&summary, 0, sizeof(summary));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    int next = 0;
+    int active = 0;
+    bool cancelled = false;
+
+    while (active > 0 || (next < input_count && !cancelled))
+    {
+        // Fill every free slot, then sleep until a child exits and refill the slots it frees.
+        for (int i = 0; i < max_jobs && next < input_count && !cancelled; i++)
+        {
+            if (running[i] != NULL)
+            {
+                continue;
+            }
+
+            running[i] = parallelLaunch(command, command_len, inputs[next++]);
+            summary.launched++;
+            if (running[i] == NULL)
+            {
+                summary.failed++;
+                continue;
+            }
+            active++;
+        }
+
+        if (active == 0)
+        {
+            continue;
+        }
+
+        if (!parallelWait(running, max_jobs))
+        {
+            cancelled = true;
+        }
+
+        for (int i = 0; i < max_jobs; i++)
+        {
+            if (running[i] != NULL && running[i]->state == JOB_DONE)
+            {
+                parallelCollect(running[i], &summary);
+                running[i] = NULL;
+                active--;
+            }
+        }
+    }
+
+    // The prompt still has to see stdin's end of file to exit.
+    eventWatchInput(true);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("\rparallel: %d jobs, %d succeeded, %d failed in %.3fs%s\n", summary.launched,
+           summary.launched - summary.failed, summary.failed, elapsed, cancelled ? " (cancelled)" : "");
+    for (int code = 1; code < 256; code++)
+    {
+        if (summary.codes[code] > 0)
+        {
+            printf("\r  exit %d: %d\n", code, summary.codes[code]);
+        }
+    }
+
+    if (owned_inputs)
+    {
+        for (int i = 0; i < input_count; i++)
+        {
+            free(inputs[i]);
+        }
+        free(inputs);
+    }
+    free(running);
+
+    return summary.failed > 0 || cancelled ? 1 : 0;
+}
@@ -0,0 +1,332 @@
+#include "boone.h"
+
+#include <dlfcn.h>
+#include <limits.h>
+
+struct plugin
+{
+    char* path;
+    void* handle;
+};
+
+struct plugin_builtin
+{
+    char* name;
+    boone_builtin fn;
+    int owner;
+};
+
+static struct plugin plugins[PLUGIN_MAX];
+static struct plugin_builtin plugin_builtins[PLUGIN_BUILTIN_MAX];
+static int plugin_builtin_count = 0;
+
+// Index of the plugin whose init is running, builtins registered meanwhile belong to it.
+static int plugin_loading = -1;
+
+static bool pluginNameTaken(const char* name)
+{
+    for (size_t i = 0; i < shell_commands_size(); i++)
+    {
+        if (strcmp(name, shell_commands[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return pluginFind(name) != NULL;
+}
+
+static int pluginRegister(const char* name, boone_builtin fn)
+{
+    if (plugin_loading == -1 || plugin_builtin_count == PLUGIN_BUILTIN_MAX || pluginNameTaken(name))
+    {
+        return -1;
+    }
+
+    char* copy = strdup(name);
+    if (copy == NULL)
+    {
+        return -1;
+    }
+
+    plugin_builtins[plugin_builtin_count].name = copy;
+    plugin_builtins[plugin_builtin_count].fn = fn;
+    plugin_builtins[plugin_builtin_count].owner = plugin_loading;
+    plugin_builtin_count++;
+    return 0;
+}
+
+static const struct boone_host plugin_host = {
+    .abi = BOONE_PLUGIN_ABI,
+    .jobs = jobs,
+    .job_max = JOB_MAX,
+    .register_builtin = pluginRegister,
+    .write = outputWrite,
+    .printf = outputPrintf
+};
+
+int outputReserve(struct boone_output* out, size_t len)
+{
+    if (out->len + len + 1 > out->cap)
+    {
+        size_t cap = out->cap > 0 ? out->cap : 256;
+        while (out->len + len + 1 > cap)
+        {
+            cap *= 2;
+        }
+
+        char* grown = realloc(out->data, cap);
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        out->data = grown;
+        out->cap = cap;
+    }
+    return 0;
+}
+
+int outputWrite(struct boone_output* out, const char* data, size_t len)
+{
+    if (outputReserve(out, len) == -1)
+    {
+        return -1;
+    }
+
+    memcpy(out->data + out->len, data, len);
+    out->len += len;
+    out->data[out->len] = '\0';
+    return 0;
+}
+
+int outputPrintf(struct boone_output* out, const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    char* str;
+    int len = vasprintf(&str, format, args);
+    va_end(args);
+
+    if (len == -1)
+    {
+        return -1;
+    }
+
+    int result = outputWrite(out, str, len);
+    free(str);
+    return result;
+}
+
+void outputFree(struct boone_output* out)
+{
+    free(out->data);
+    out->data = NULL;
+    out->len = 0;
+    out->cap = 0;
+}
+
+// The terminal is in raw mode while builtins run, so every newline needs its carriage return.
+static void outputFlush(struct boone_output* out)
+{
+    size_t newlines = 0;
+    for (size_t i = 0; i < out->len; i++)
+    {
+        newlines += out->data[i] == '\n';
+    }
+
+    char* translated = malloc(out->len + newlines);
+    if (translated == NULL)
+    {
+        write(STDOUT_FILENO, out->data, out->len);
+        return;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < out->len; i++)
+    {
+        if (out->data[i] == '\n')
+        {
+            translated[len++] = '\r';
+        }
+        translated[len++] = out->data[i];
+    }
+
+    write(STDOUT_FILENO, translated, len);
+    free(translated);
+}
+
+boone_builtin pluginFind(const char* name)
+{
+    for (int i = 0; i < plugin_builtin_count; i++)
+    {
+        if (strcmp(name, plugin_builtins[i].name) == 0)
+        {
+            return plugin_builtins[i].fn;
+        }
+    }
+    return NULL;
+}
+
+int pluginRun(boone_builtin fn, char** args)
+{
+    struct boone_output out;
+    memset(&out, 0, sizeof(out));
+
+    fflush(stdout);
+    int result = fn(args, &out);
+    outputFlush(&out);
+    outputFree(&out);
+
+    return result;
+}
+
+// Drops every builtin the plugin registered, keeping the rest in order.
+static void pluginForget(int index)
+{
+    int kept = 0;
+    for (int i = 0; i < plugin_builtin_count; i++)
+    {
+        if (plugin_builtins[i].owner == index)
+        {
+            free(plugin_builtins[i].name);
+            continue;
+        }
+        plugin_builtins[kept++] = plugin_builtins[i];
+    }
+    plugin_builtin_count = kept;
+}
+
+static void pluginUnload(int index)
+{
+    boone_plugin_fini_fn fini = (boone_plugin_fini_fn)dlsym(plugins[index].handle, "boone_plugin_fini");
+    if (fini != NULL)
+    {
+        fini();
+    }
+
+    pluginForget(index);
+    dlclose(plugins[index].handle);
+    free(plugins[index].path);
+    plugins[index].path = NULL;
+    plugins[index].handle = NULL;
+}
+
+// Finds a loaded plugin by the path it was loaded from, as given or resolved.
+static int pluginIndex(const char* path)
+{
+    char resolved[PATH_MAX];
+    bool has_resolved = realpath(path, resolved) != NULL;
+
+    for (int i = 0; i < PLUGIN_MAX; i++)
+    {
+        if (plugins[i].path == NULL)
+        {
+            continue;
+        }
+        if (strcmp(plugins[i].path, path) == 0 || (has_resolved && strcmp(plugins[i].path, resolved) == 0))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void pluginList(void)
+{
+    for (int i = 0; i < PLUGIN_MAX; i++)
+    {
+        if (plugins[i].path == NULL)
+        {
+            continue;
+        }
+
+        printf("\r%s:", plugins[i].path);
+        for (int j = 0; j < plugin_builtin_count; j++)
+        {
+            if (plugin_builtins[j].owner == i)
+            {
+                printf(" %s", plugin_builtins[j].name);
+            }
+        }
+        printf("\n");
+    }
+}
+
+int shell_load(char** args)
+{
+    if (args[1] == NULL)
+    {
+        pluginList();
+        return 0;
+    }
+
+    char path[PATH_MAX];
+    if (realpath(args[1], path) == NULL)
+    {
+        perror("Could not find plugin! ");
+        return 1;
+    }
+
+    // Loading a plugin again reloads it, picking up a rebuilt .so.
+    int index = pluginIndex(path);
+    if (index != -1)
+    {
+        pluginUnload(index);
+    }
+
+    for (index = 0; index < PLUGIN_MAX && plugins[index].path != NULL; index++);
+    if (index == PLUGIN_MAX)
+    {
+        fprintf(stderr, "\rCould not load %s, too many plugins!\n", path);
+        return 1;
+    }
+
+    void* handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL)
+    {
+        fprintf(stderr, "\rCould not load plugin! %s\n", dlerror());
+        return 1;
+    }
+
+    boone_plugin_init_fn init = (boone_plugin_init_fn)dlsym(handle, "boone_plugin_init");
+    if (init == NULL)
+    {
+        fprintf(stderr, "\rCould not load %s, it has no boone_plugin_init!\n", path);
+        dlclose(handle);
+        return 1;
+    }
+
+    plugin_loading = index;
+    int result = init(&plugin_host);
+    plugin_loading = -1;
+
+    if (result != 0)
+    {
+        fprintf(stderr, "\rCould not load %s, its init failed with %d!\n", path, result);
+        pluginForget(index);
+        dlclose(handle);
+        return 1;
+    }
+
+    plugins[index].path = strdup(path);
+    plugins[index].handle = handle;
+    return 0;
+}
+
+int shell_unload(char** args)
+{
+    if (args[1] == NULL)
+    {
+        printf("\r%s\n", "Usage: unload path/to/plugin.so");
+        return 1;
+    }
+
+    int index = pluginIndex(args[1]);
+    if (index == -1)
+    {
+        fprintf(stderr, "\r%s is not loaded!\n", args[1]);
+        return 1;
+    }
+
+    pluginUnload(index);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#ifndef PLUGIN_H
+#define PLUGIN_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "jobs.h"
+
+/**
+ * The C ABI between the shell and builtins loaded with `load path/to/plugin.so`.
+ * A plugin exports boone_plugin_init, which checks the ABI version and registers
+ * its builtins through the host table. Those builtins then run inside the shell
+ * at the cost of a function call, with no fork or exec.
+ *
+ * Builtins don't print directly, they append to the output buffer they are given.
+ * The shell flushes it to the terminal once the builtin returns.
+ */
+
+// Bumped whenever a struct or function below changes incompatibly.
+#define BOONE_PLUGIN_ABI 4
+
+#define PLUGIN_MAX 32
+#define PLUGIN_BUILTIN_MAX 256
+
+struct boone_output
+{
+    char* data;
+    size_t len;
+    size_t cap;
+};
+
+// Returned by a builtin to exit the shell.
+#define BOONE_BUILTIN_EXIT -1
+
+// Same contract as the static builtins: they return their exit status, or BOONE_BUILTIN_EXIT.
+typedef int (*boone_builtin)(char** argv, struct boone_output* out);
+
+struct boone_host
+{
+    uint32_t abi;
+
+    // The shell's job table, read only to plugins.
+    const struct job* jobs;
+    int job_max;
+
+    // Registers name as a builtin. Returns -1 if the name is already taken or the table is full.
+    int (*register_builtin)(const char* name, boone_builtin fn);
+
+    // Append to an output buffer. Return -1 if it couldn't grow.
+    int (*write)(struct boone_output* out, const char* data, size_t len);
+    int (*printf)(struct boone_output* out, const char* format, ...);
+};
+
+// Exported by every plugin. Returns 0 once its builtins are registered, anything else refuses the load.
+typedef int (*boone_plugin_init_fn)(const struct boone_host* host);
+
+// Optionally exported, called before the plugin is unloaded.
+typedef void (*boone_plugin_fini_fn)(void);
+
+// Shell side.
+int shell_load(char** args);
+int shell_unload(char** args);
+
+// Returns the plugin builtin called name, or NULL.
+boone_builtin pluginFind(const char* name);
+
+// Runs a plugin builtin and writes its output to the terminal.
+int pluginRun(boone_builtin fn, char** args);
+
+// Makes room for len more bytes after out->len, so callers can read straight into the buffer.
+int outputReserve(struct boone_output* out, size_t len);
+int outputWrite(struct boone_output* out, const char* data, size_t len);
+int outputPrintf(struct boone_output* out, const char* format, ...);
+void outputFree(struct boone_output* out);
+
+#endif
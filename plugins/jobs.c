@@ -0,0 +1,44 @@
+/**
+ * Example plugin adding a `jobs` builtin that lists the job table.
+ * Build it with `make plugins` and load it with `load plugins/jobs.so`.
+ */
+#include "../plugin.h"
+
+static const struct boone_host* host;
+
+static const char* jobStateName(int state)
+{
+    switch (state)
+    {
+        case JOB_RUNNING:
+            return "Running";
+        case JOB_STOPPED:
+            return "Stopped";
+        default:
+            return "Done";
+    }
+}
+
+static int jobsBuiltin(char** argv, struct boone_output* out)
+{
+    for (int i = 0; i < host->job_max; i++)
+    {
+        const struct job* job = &host->jobs[i];
+        if (job->state != JOB_FREE)
+        {
+            host->printf(out, "[%d] %-8s %d %s\n", i, jobStateName(job->state), job->pid, job->command);
+        }
+    }
+    return 0;
+}
+
+int boone_plugin_init(const struct boone_host* boone)
+{
+    if (boone->abi != BOONE_PLUGIN_ABI)
+    {
+        return 1;
+    }
+
+    host = boone;
+    return host->register_builtin("jobs", jobsBuiltin);
+}
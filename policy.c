@@ -0,0 +1,210 @@
+#include "policy.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+struct launch_policy background_policy;
+const struct launch_policy* policy_override = NULL;
+
+struct policy_limit
+{
+    const char* key;
+    int resource;
+
+    // Whether the value takes a K, M or G suffix.
+    bool is_size;
+};
+
+static const struct policy_limit policy_limits[] = {
+    { "mem", RLIMIT_AS, true },
+    { "cpu", RLIMIT_CPU, false },
+    { "files", RLIMIT_NOFILE, false },
+    { "procs", RLIMIT_NPROC, false },
+    { "core", RLIMIT_CORE, true },
+    { "stack", RLIMIT_STACK, true }
+};
+
+static int policyParseCpus(cpu_set_t* cpus, const char* list)
+{
+    CPU_ZERO(cpus);
+
+    const char* p = list;
+    while (*p != '\0')
+    {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p)
+        {
+            return -1;
+        }
+
+        if (*end == '-')
+        {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+            {
+                return -1;
+            }
+        }
+
+        if (first < 0 || last < first || last >= CPU_SETSIZE)
+        {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+
+        if (*end == ',')
+        {
+            end++;
+        }
+        else if (*end != '\0')
+        {
+            return -1;
+        }
+        p = end;
+    }
+
+    return CPU_COUNT(cpus) > 0 ? 0 : -1;
+}
+
+static int policyParseNumber(const char* value, bool is_size, rlim_t* number)
+{
+    if (strcmp(value, "unlimited") == 0)
+    {
+        *number = RLIM_INFINITY;
+        return 0;
+    }
+
+    char* end;
+    errno = 0;
+    unsigned long long parsed = strtoull(value, &end, 10);
+    if (end == value || errno != 0)
+    {
+        return -1;
+    }
+
+    if (is_size)
+    {
+        switch (*end)
+        {
+            case 'G': case 'g': parsed <<= 10; /* fall through */
+            case 'M': case 'm': parsed <<= 10; /* fall through */
+            case 'K': case 'k': parsed <<= 10; end++; break;
+        }
+    }
+
+    if (*end != '\0')
+    {
+        return -1;
+    }
+
+    *number = parsed;
+    return 0;
+}
+
+int policyParse(struct launch_policy* policy, char** args)
+{
+    memset(policy, 0, sizeof(struct launch_policy));
+
+    int i = 0;
+    for (; args[i] != NULL && strcmp(args[i], "--") != 0; i++)
+    {
+        char* value = strchr(args[i], '=');
+        if (value == NULL)
+        {
+            fprintf(stderr, "\rExpected key=value, got %s!\n", args[i]);
+            return -1;
+        }
+
+        size_t key_len = value - args[i];
+        value++;
+
+        if (key_len == 4 && strncmp(args[i], "cpus", 4) == 0)
+        {
+            if (policyParseCpus(&policy->cpus, value) == -1)
+            {
+                fprintf(stderr, "\rInvalid cpu list %s!\n", value);
+                return -1;
+            }
+            policy->has_cpus = true;
+            continue;
+        }
+
+        if (key_len == 4 && strncmp(args[i], "nice", 4) == 0)
+        {
+            char* end;
+            long nice = strtol(value, &end, 10);
+            if (end == value || *end != '\0' || nice < -20 || nice > 19)
+            {
+                fprintf(stderr, "\rInvalid nice value %s!\n", value);
+                return -1;
+            }
+            policy->nice = nice;
+            policy->has_nice = true;
+            continue;
+        }
+
+        const struct policy_limit* limit = NULL;
+        for (size_t j = 0; j < sizeof(policy_limits) / sizeof(policy_limits[0]); j++)
+        {
+            if (strlen(policy_limits[j].key) == key_len && strncmp(args[i], policy_limits[j].key, key_len) == 0)
+            {
+                limit = &policy_limits[j];
+                break;
+            }
+        }
+
+        rlim_t number;
+        if (limit == NULL || policy->rlimit_count == POLICY_MAX_RLIMITS ||
+            policyParseNumber(value, limit->is_size, &number) == -1)
+        {
+            fprintf(stderr, "\rInvalid launch policy %s!\n", args[i]);
+            return -1;
+        }
+
+        policy->rlimit_resources[policy->rlimit_count] = limit->resource;
+        policy->rlimits[policy->rlimit_count].rlim_cur = number;
+        policy->rlimits[policy->rlimit_count].rlim_max = number;
+        policy->rlimit_count++;
+    }
+
+    return args[i] != NULL ? i + 1 : i;
+}
+
+bool policyIsSet(const struct launch_policy* policy)
+{
+    return policy->has_cpus || policy->has_nice || policy->rlimit_count > 0;
+}
+
+int policyApply(const struct launch_policy* policy)
+{
+    if (policy->has_cpus && sched_setaffinity(0, sizeof(cpu_set_t), &policy->cpus) == -1)
+    {
+        perror("Could not set cpu affinity! ");
+        return -1;
+    }
+
+    if (policy->has_nice && setpriority(PRIO_PROCESS, 0, policy->nice) == -1)
+    {
+        perror("Could not set nice value! ");
+        return -1;
+    }
+
+    for (int i = 0; i < policy->rlimit_count; i++)
+    {
+        if (setrlimit(policy->rlimit_resources[i], &policy->rlimits[i]) == -1)
+        {
+            perror("Could not set resource limit! ");
+            return -1;
+        }
+    }
+
+    return 0;
+}
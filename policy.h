@@ -0,0 +1,43 @@
+#ifndef POLICY_H
+#define POLICY_H
+
+#include <stdbool.h>
+#include <sched.h>
+#include <sys/resource.h>
+
+#define POLICY_MAX_RLIMITS 8
+
+/**
+ * Scheduling and resource limits applied to a child between fork and exec,
+ * so no taskset or nice wrapper process is needed. Written as key=value
+ * pairs, e.g. cpus=0-3,8 nice=10 mem=2G cpu=60 files=1024 procs=512 core=0.
+ */
+struct launch_policy
+{
+    bool has_cpus;
+    cpu_set_t cpus;
+
+    bool has_nice;
+    int nice;
+
+    int rlimit_count;
+    int rlimit_resources[POLICY_MAX_RLIMITS];
+    struct rlimit rlimits[POLICY_MAX_RLIMITS];
+};
+
+// Policy given to jobs that don't run in the foreground, set with `on --default`.
+extern struct launch_policy background_policy;
+
+// While set, overrides the policy of everything spawned. Used by `on` when it runs a builtin like parallel.
+extern const struct launch_policy* policy_override;
+
+// Parses key=value pairs into policy until "--" or the end of args. Returns the index after them, or -1 on error.
+int policyParse(struct launch_policy* policy, char** args);
+
+// Returns true if the policy would change anything.
+bool policyIsSet(const struct launch_policy* policy);
+
+// Applies the policy to the calling process. Meant for the child after fork, returns -1 on the first failure.
+int policyApply(const struct launch_policy* policy);
+
+#endif
@@ -0,0 +1,287 @@
+#include "prompt.h"
+#include "editor.h"
+#include "event.h"
+#include "worker.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#define PROMPT_CACHE_BUCKETS 64
+
+struct prompt_cache_entry
+{
+    char* dir;
+    char* branch;
+    struct prompt_cache_entry* next;
+};
+
+struct prompt_state prompt_state = { .status = 0 };
+
+/**
+ * Branches already looked up, per directory. The worker thread fills it in
+ * and wakes the event loop through prompt_notify_fd.
+ */
+static struct prompt_cache_entry* prompt_cache[PROMPT_CACHE_BUCKETS];
+static pthread_mutex_t prompt_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int prompt_notify_fd = -1;
+
+static size_t promptHash(const char* dir)
+{
+    size_t hash = 5381;
+    for (; *dir != '\0'; dir++)
+    {
+        hash = hash * 33 + (unsigned char) *dir;
+    }
+    return hash % PROMPT_CACHE_BUCKETS;
+}
+
+// Returns a copy of the cached branch for dir. Sets *found if dir has been looked up at all.
+static char* promptCacheGet(const char* dir, bool* found)
+{
+    char* branch = NULL;
+    *found = false;
+
+    pthread_mutex_lock(&prompt_cache_lock);
+    for (struct prompt_cache_entry* entry = prompt_cache[promptHash(dir)]; entry != NULL; entry = entry->next)
+    {
+        if (strcmp(entry->dir, dir) == 0)
+        {
+            *found = true;
+            branch = entry->branch != NULL ? strdup(entry->branch) : NULL;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&prompt_cache_lock);
+
+    return branch;
+}
+
+static void promptCacheSet(const char* dir, char* branch)
+{
+    size_t bucket = promptHash(dir);
+
+    pthread_mutex_lock(&prompt_cache_lock);
+    struct prompt_cache_entry* entry = prompt_cache[bucket];
+    while (entry != NULL && strcmp(entry->dir, dir) != 0)
+    {
+        entry = entry->next;
+    }
+
+    if (entry == NULL)
+    {
+        entry = calloc(1, sizeof(struct prompt_cache_entry));
+        if (entry == NULL)
+        {
+            pthread_mutex_unlock(&prompt_cache_lock);
+            free(branch);
+            return;
+        }
+        entry->dir = strdup(dir);
+        entry->next = prompt_cache[bucket];
+        prompt_cache[bucket] = entry;
+    }
+
+    free(entry->branch);
+    entry->branch = branch;
+    pthread_mutex_unlock(&prompt_cache_lock);
+}
+
+// Reads the first line of a file under dir into line, without the newline.
+static bool promptReadLine(const char* dir, const char* name, char* line, size_t size)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE* file = fopen(path, "r");
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    bool read = fgets(line, size, file) != NULL;
+    fclose(file);
+
+    if (read)
+    {
+        line[strcspn(line, "\n")] = '\0';
+    }
+    return read;
+}
+
+/**
+ * Finds the branch checked out in the repository containing dir by reading
+ * .git/HEAD directly, walking up to the root. Returns NULL outside a repository.
+ */
+static char* promptGitBranch(const char* dir)
+{
+    char path[PATH_MAX];
+    char line[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", dir);
+
+    while (true)
+    {
+        char git_dir[PATH_MAX + 8];
+        snprintf(git_dir, sizeof(git_dir), "%s/.git", path);
+
+        // Worktrees and submodules have a .git file pointing at the real git directory.
+        bool found = promptReadLine(git_dir, "HEAD", line, sizeof(line));
+        if (!found && promptReadLine(path, ".git", line, sizeof(line)) && strncmp(line, "gitdir: ", 8) == 0)
+        {
+            if (line[8] == '/')
+            {
+                snprintf(git_dir, sizeof(git_dir), "%s", line + 8);
+            }
+            else
+            {
+                snprintf(git_dir, sizeof(git_dir), "%s/%s", path, line + 8);
+            }
+            found = promptReadLine(git_dir, "HEAD", line, sizeof(line));
+        }
+
+        if (found)
+        {
+            if (strncmp(line, "ref: refs/heads/", 16) == 0)
+            {
+                return strdup(line + 16);
+            }
+
+            // Detached HEAD, show the abbreviated commit instead.
+            line[7] = '\0';
+            return strdup(line);
+        }
+
+        char* slash = strrchr(path, '/');
+        if (slash == NULL || slash == path)
+        {
+            return NULL;
+        }
+        *slash = '\0';
+    }
+}
+
+static void promptLookup(void* arg)
+{
+    char* dir = arg;
+    promptCacheSet(dir, promptGitBranch(dir));
+    free(dir);
+
+    uint64_t one = 1;
+    write(prompt_notify_fd, &one, sizeof(one));
+}
+
+// Formats the segments and recomputes the width, moving the cursor along with the command.
+static void promptRender(void)
+{
+    int old_width = prompt_state.width;
+    size_t len = 0;
+
+    if (prompt_state.branch != NULL)
+    {
+        len += snprintf(prompt_state.segments + len, sizeof(prompt_state.segments) - len,
+                        " (%.256s)", prompt_state.branch);
+    }
+    if (prompt_state.status != 0)
+    {
+        len += snprintf(prompt_state.segments + len, sizeof(prompt_state.segments) - len,
+                        " [%d]", prompt_state.status);
+    }
+
+    prompt_state.segments_len = len;
+    prompt_state.width = prompt_state.cwd_len + len + strlen(PROMPT);
+
+    if (editor_state.cwd_str_len != 0)
+    {
+        editor_state.x += prompt_state.width - old_width;
+    }
+    editor_state.cwd_str_len = prompt_state.width + 1;
+}
+
+// Picks up the cached branch for the working directory. Returns true if it changed.
+static bool promptApplyBranch(void)
+{
+    bool found;
+    char* branch = promptCacheGet(prompt_state.cwd, &found);
+
+    if (!found)
+    {
+        return false;
+    }
+
+    bool changed = (branch == NULL) != (prompt_state.branch == NULL) ||
+                   (branch != NULL && strcmp(branch, prompt_state.branch) != 0);
+
+    free(prompt_state.branch);
+    prompt_state.branch = branch;
+    return changed;
+}
+
+static void promptNotified(int fd, void* data)
+{
+    uint64_t count;
+    read(fd, &count, sizeof(count));
+
+    if (prompt_state.cwd != NULL && promptApplyBranch())
+    {
+        promptRender();
+        eventRequestRefresh();
+    }
+}
+
+void promptChangedDirectory(void)
+{
+    char* cwd = getcwd(NULL, 0);
+    if (cwd == NULL)
+    {
+        perror("Could not get working directory! ");
+        return;
+    }
+
+    free(prompt_state.cwd);
+    prompt_state.cwd = cwd;
+    prompt_state.cwd_len = strlen(cwd);
+
+    // Show whatever we know about the new directory right away, the lookup fixes it up later.
+    free(prompt_state.branch);
+    prompt_state.branch = NULL;
+    promptApplyBranch();
+    promptRender();
+}
+
+void promptSetStatus(int status)
+{
+    if (status != prompt_state.status)
+    {
+        prompt_state.status = status;
+        promptRender();
+    }
+}
+
+void promptRefresh(void)
+{
+    if (prompt_state.cwd == NULL)
+    {
+        promptChangedDirectory();
+        if (prompt_state.cwd == NULL)
+        {
+            return;
+        }
+    }
+
+    if (prompt_notify_fd == -1)
+    {
+        prompt_notify_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (prompt_notify_fd == -1 || eventAdd(prompt_notify_fd, promptNotified, NULL) == -1)
+        {
+            perror("Could not set up prompt segments! ");
+            return;
+        }
+    }
+
+    // The branch can change between prompts, so look it up again even when it is cached.
+    char* dir = strdup(prompt_state.cwd);
+    if (dir != NULL && workerSubmit(promptLookup, dir) == -1)
+    {
+        free(dir);
+    }
+}
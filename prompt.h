@@ -0,0 +1,41 @@
+#ifndef PROMPT_H
+#define PROMPT_H
+
+#include <stddef.h>
+
+/**
+ * Everything drawn before the command: the working directory, the optional
+ * segments and the PROMPT characters. It is only rebuilt when one of its
+ * parts changes, together with its rendered width.
+ */
+struct prompt_state
+{
+    char* cwd;
+    size_t cwd_len;
+
+    // Git branch of the working directory, looked up on the worker thread. NULL outside a repository.
+    char* branch;
+
+    // Exit status of the last foreground program, only shown when non-zero.
+    int status;
+
+    // Segments already formatted for the screen, along with their length.
+    char segments[320];
+    size_t segments_len;
+
+    // Columns taken up by the whole prompt.
+    int width;
+};
+
+extern struct prompt_state prompt_state;
+
+// Reads the working directory. Called at startup and whenever cd succeeds.
+void promptChangedDirectory(void);
+
+// Records the exit status of the last foreground program.
+void promptSetStatus(int status);
+
+// Called before each new prompt, kicks off a background lookup of the slow segments.
+void promptRefresh(void);
+
+#endif
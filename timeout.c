@@ -0,0 +1,225 @@
+#include "boone.h"
+#include <math.h>
+
+// Grace period between the timeout signal and SIGKILL unless --kill-after says otherwise.
+#define TIMEOUT_GRACE_NS (5 * 1000000000ULL)
+
+struct timeout_signal
+{
+    const char* name;
+    int number;
+};
+
+static const struct timeout_signal timeout_signals[] = {
+    { "HUP", SIGHUP },
+    { "INT", SIGINT },
+    { "QUIT", SIGQUIT },
+    { "KILL", SIGKILL },
+    { "USR1", SIGUSR1 },
+    { "USR2", SIGUSR2 },
+    { "ALRM", SIGALRM },
+    { "TERM", SIGTERM }
+};
+
+// Parses durations like 10, 1.5s, 250ms, 2m or 1h into nanoseconds. Returns -1 if invalid.
+static int timeoutParseDuration(const char* str, uint64_t* ns)
+{
+    char* end;
+    double value = strtod(str, &end);
+    if (end == str || !isfinite(value) || value < 0)
+    {
+        return -1;
+    }
+
+    double scale = 1e9;
+    if (strcmp(end, "ms") == 0)
+    {
+        scale = 1e6;
+    }
+    else if (strcmp(end, "m") == 0)
+    {
+        scale = 60e9;
+    }
+    else if (strcmp(end, "h") == 0)
+    {
+        scale = 3600e9;
+    }
+    else if (strcmp(end, "s") != 0 && *end != '\0')
+    {
+        return -1;
+    }
+
+    // Anything near UINT64_MAX would overflow once the grace period is added, and is centuries anyway.
+    if (value * scale >= UINT64_MAX / 2)
+    {
+        return -1;
+    }
+
+    *ns = value * scale;
+    return 0;
+}
+
+// Parses TERM, SIGTERM or 15. Returns -1 if invalid.
+static int timeoutParseSignal(const char* str)
+{
+    if (isdigit(str[0]))
+    {
+        int number = atoi(str);
+        return number > 0 && number < NSIG ? number : -1;
+    }
+
+    if (strncmp(str, "SIG", 3) == 0)
+    {
+        str += 3;
+    }
+
+    for (size_t i = 0; i < sizeof(timeout_signals) / sizeof(timeout_signals[0]); i++)
+    {
+        if (strcasecmp(str, timeout_signals[i].name) == 0)
+        {
+            return timeout_signals[i].number;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Parses the options shared by timeout and watchdog, starting at args[*i].
+ * Stops at the first argument that isn't an option. Returns -1 on error.
+ */
+static int timeoutParseOptions(char** args, int* i, int* sig, uint64_t* grace_ns)
+{
+    while (args[*i] != NULL && strncmp(args[*i], "--", 2) == 0)
+    {
+        if (strcmp(args[*i], "--") == 0)
+        {
+            (*i)++;
+            return 0;
+        }
+
+        if (args[*i + 1] == NULL)
+        {
+            fprintf(stderr, "\rMissing value for %s!\n", args[*i]);
+            return -1;
+        }
+
+        if (strcmp(args[*i], "--signal") == 0)
+        {
+            *sig = timeoutParseSignal(args[*i + 1]);
+            if (*sig == -1)
+            {
+                fprintf(stderr, "\rUnknown signal %s!\n", args[*i + 1]);
+                return -1;
+            }
+        }
+        else if (strcmp(args[*i], "--kill-after") == 0)
+        {
+            if (timeoutParseDuration(args[*i + 1], grace_ns) == -1)
+            {
+                fprintf(stderr, "\rInvalid duration %s!\n", args[*i + 1]);
+                return -1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "\rUnknown option %s!\n", args[*i]);
+            return -1;
+        }
+
+        *i += 2;
+    }
+
+    return 0;
+}
+
+int shell_timeout(char** args)
+{
+    int sig = SIGTERM;
+    uint64_t grace_ns = TIMEOUT_GRACE_NS;
+    uint64_t timeout_ns;
+    int i = 1;
+
+    if (timeoutParseOptions(args, &i, &sig, &grace_ns) == -1)
+    {
+        return 1;
+    }
+
+    if (args[i] == NULL || timeoutParseDuration(args[i], &timeout_ns) == -1)
+    {
+        printf("\r%s\n", "Usage: timeout DURATION [--signal SIG] [--kill-after DURATION] command");
+        return 1;
+    }
+    i++;
+
+    if (timeoutParseOptions(args, &i, &sig, &grace_ns) == -1)
+    {
+        return 1;
+    }
+
+    if (args[i] == NULL)
+    {
+        printf("\r%s\n", "Usage: timeout DURATION [--signal SIG] [--kill-after DURATION] command");
+        return 1;
+    }
+
+    bool builtin = pluginFind(args[i]) != NULL;
+    for (size_t j = 0; j < shell_commands_size(); j++)
+    {
+        builtin |= strcmp(args[i], shell_commands[j]) == 0;
+    }
+
+    if (builtin)
+    {
+        fprintf(stderr, "\rtimeout can only limit programs, %s is a builtin!\n", args[i]);
+        return 1;
+    }
+
+    // Runs in the foreground like any other program, the timer fires from the event loop.
+    struct job* job = spawn_process(args + i, NULL);
+    if (job == NULL)
+    {
+        return 1;
+    }
+
+    child_pid = job->pid;
+    jobSetTimer(job, timeout_ns, sig, grace_ns);
+    return 0;
+}
+
+int shell_watchdog(char** args)
+{
+    int sig = SIGTERM;
+    uint64_t grace_ns = TIMEOUT_GRACE_NS;
+    uint64_t timeout_ns;
+
+    if (args[1] == NULL || args[2] == NULL)
+    {
+        printf("\r%s\n", "Usage: watchdog JOB DURATION|off [--signal SIG] [--kill-after DURATION]");
+        return 1;
+    }
+
+    char* end;
+    long id = strtol(args[1], &end, 10);
+    if (end == args[1] || *end != '\0' || id < 0 || id >= JOB_MAX ||
+        jobs[id].state == JOB_FREE || jobs[id].state == JOB_DONE)
+    {
+        fprintf(stderr, "\rNo job %s!\n", args[1]);
+        return 1;
+    }
+
+    if (strcmp(args[2], "off") == 0)
+    {
+        jobCancelTimer(&jobs[id]);
+        return 0;
+    }
+
+    int i = 3;
+    if (timeoutParseDuration(args[2], &timeout_ns) == -1 || timeoutParseOptions(args, &i, &sig, &grace_ns) == -1)
+    {
+        fprintf(stderr, "\rInvalid watchdog %s!\n", args[2]);
+        return 1;
+    }
+
+    jobSetTimer(&jobs[id], timeout_ns, sig, grace_ns);
+    return 0;
+}
@@ -0,0 +1,199 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+struct trace_record
+{
+    // The record's position in the stream + 1 once it is filled in, so the flusher can spot torn or lapped records.
+    _Atomic uint64_t seq;
+    uint64_t time_ns;
+    uint32_t arg;
+    uint32_t type;
+};
+
+static struct trace_record trace_ring[TRACE_RING_SIZE];
+static _Atomic uint64_t trace_head = 0;
+static uint64_t trace_tail = 0;
+static uint64_t trace_last_ns = 0;
+static int trace_fd = -1;
+static pid_t trace_pid = 0;
+
+static uint64_t traceNow(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int traceOpen(const char* path)
+{
+    trace_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (trace_fd == -1)
+    {
+        perror("Could not open trace file! ");
+        return -1;
+    }
+
+    trace_pid = getpid();
+    trace_last_ns = traceNow();
+
+    unsigned char header[13];
+    memcpy(header, TRACE_MAGIC, 4);
+    header[4] = TRACE_VERSION;
+    for (int i = 0; i < 8; i++)
+    {
+        header[5 + i] = trace_last_ns >> (i * 8);
+    }
+
+    if (write(trace_fd, header, sizeof(header)) != sizeof(header))
+    {
+        perror("Could not write trace file! ");
+        close(trace_fd);
+        trace_fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+void traceClose(void)
+{
+    // Children that failed to exec run our atexit handlers too, only the shell itself owns the trace.
+    if (trace_fd == -1 || getpid() != trace_pid)
+    {
+        return;
+    }
+
+    traceFlush(true);
+    close(trace_fd);
+    trace_fd = -1;
+}
+
+void traceEvent(int type, uint32_t arg)
+{
+    if (trace_fd == -1)
+    {
+        return;
+    }
+
+    uint64_t seq = atomic_fetch_add_explicit(&trace_head, 1, memory_order_relaxed);
+    struct trace_record* record = &trace_ring[seq & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&record->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    record->time_ns = traceNow();
+    record->arg = arg;
+    record->type = type;
+    atomic_store_explicit(&record->seq, seq + 1, memory_order_release);
+}
+
+static size_t traceVarint(unsigned char* out, uint64_t value)
+{
+    size_t len = 0;
+    do
+    {
+        unsigned char byte = value & 0x7f;
+        value >>= 7;
+        out[len++] = byte | (value != 0 ? 0x80 : 0);
+    }
+    while (value != 0);
+
+    return len;
+}
+
+static size_t traceEncode(unsigned char* out, int type, uint64_t time_ns, uint32_t arg)
+{
+    // Events from different threads can land slightly out of order, so the delta is zigzag encoded.
+    int64_t delta = (int64_t) (time_ns - trace_last_ns);
+    uint64_t zigzag = ((uint64_t) delta << 1) ^ (uint64_t) (delta >> 63);
+    trace_last_ns = time_ns;
+
+    size_t len = 0;
+    out[len++] = type;
+    len += traceVarint(out + len, zigzag);
+    len += traceVarint(out + len, arg);
+    return len;
+}
+
+void traceFlush(bool force)
+{
+    if (trace_fd == -1 || getpid() != trace_pid)
+    {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&trace_head, memory_order_acquire);
+    if (!force && head - trace_tail < TRACE_RING_SIZE / 2)
+    {
+        return;
+    }
+
+    // Every record encodes to at most 1 + 10 + 5 bytes.
+    size_t chunk_cap = 4096 * 16;
+    unsigned char* chunk = malloc(chunk_cap);
+    if (chunk == NULL)
+    {
+        return;
+    }
+
+    size_t len = 0;
+    uint32_t dropped = 0;
+
+    if (head - trace_tail > TRACE_RING_SIZE)
+    {
+        dropped += head - TRACE_RING_SIZE - trace_tail;
+        trace_tail = head - TRACE_RING_SIZE;
+    }
+
+    for (; trace_tail < head; trace_tail++)
+    {
+        struct trace_record* record = &trace_ring[trace_tail & (TRACE_RING_SIZE - 1)];
+        uint64_t seq = atomic_load_explicit(&record->seq, memory_order_acquire);
+
+        // Still being written, stop here and pick it up on the next flush.
+        if (seq == 0 && !force)
+        {
+            break;
+        }
+
+        uint64_t time_ns = record->time_ns;
+        uint32_t arg = record->arg;
+        int type = record->type;
+
+        atomic_thread_fence(memory_order_acquire);
+        if (seq != trace_tail + 1 || atomic_load_explicit(&record->seq, memory_order_relaxed) != seq)
+        {
+            dropped++;
+            continue;
+        }
+
+        if (dropped > 0)
+        {
+            len += traceEncode(chunk + len, TRACE_DROPPED, time_ns, dropped);
+            dropped = 0;
+        }
+        len += traceEncode(chunk + len, type, time_ns, arg);
+
+        if (len > chunk_cap - 64)
+        {
+            write(trace_fd, chunk, len);
+            len = 0;
+        }
+    }
+
+    if (dropped > 0)
+    {
+        len += traceEncode(chunk + len, TRACE_DROPPED, trace_last_ns, dropped);
+    }
+    if (len > 0)
+    {
+        write(trace_fd, chunk, len);
+    }
+    free(chunk);
+}
@@ -0,0 +1,47 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_MAGIC "BTRC"
+#define TRACE_VERSION 1
+
+// Number of records buffered in memory, must be a power of two.
+#define TRACE_RING_SIZE 65536
+
+enum trace_events
+{
+    TRACE_KEY = 1,
+    TRACE_COMPLETE_START,
+    TRACE_COMPLETE_END,
+    TRACE_REFRESH_START,
+    TRACE_REFRESH_END,
+    TRACE_FORK_START,
+    TRACE_FORK_END,
+    TRACE_CHILD_EXIT,
+
+    // Written in place of records that were overwritten before they could be flushed.
+    TRACE_DROPPED
+};
+
+/**
+ * Trace file format: the 4 magic bytes, a version byte and the monotonic clock
+ * in nanoseconds as a little endian uint64_t. Every record after that is an event
+ * byte followed by two LEB128 varints, the zigzag encoded nanoseconds since the
+ * previous record and the event's argument.
+ */
+
+// Starts recording events into path. Returns -1 if the file can't be created.
+int traceOpen(const char* path);
+
+// Flushes what is left in the ring and closes the trace file.
+void traceClose(void);
+
+// Records an event. Lock-free and cheap enough to leave in hot paths, a no-op unless tracing.
+void traceEvent(int type, uint32_t arg);
+
+// Writes buffered records to the trace file once the ring is half full, or always if forced.
+void traceFlush(bool force);
+
+#endif
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "trace.h"
+
+/**
+ * Decodes a trace written by `a --trace FILE` and prints a latency
+ * histogram for every stage of the shell it can pair events up for.
+ */
+
+#define HISTOGRAM_BUCKETS 40
+#define MAX_CHILDREN 1024
+
+struct stage
+{
+    const char* name;
+    uint64_t* samples;
+    size_t count;
+    size_t cap;
+};
+
+struct child
+{
+    uint32_t pid;
+    uint64_t start_ns;
+};
+
+enum stage_ids
+{
+    STAGE_KEY,
+    STAGE_REFRESH,
+    STAGE_TAB,
+    STAGE_SHADOW,
+    STAGE_FORK,
+    STAGE_CHILD,
+    STAGE_COUNT
+};
+
+static struct stage stages[STAGE_COUNT] = {
+    { "keypress to screen" },
+    { "refresh" },
+    { "tab completion" },
+    { "shadow completion" },
+    { "fork" },
+    { "child lifetime" }
+};
+
+static void addSample(int id, uint64_t ns)
+{
+    struct stage* stage = &stages[id];
+    if (stage->count == stage->cap)
+    {
+        stage->cap = stage->cap == 0 ? 256 : stage->cap * 2;
+        stage->samples = realloc(stage->samples, stage->cap * sizeof(uint64_t));
+        if (stage->samples == NULL)
+        {
+            perror("Could not allocate! ");
+            exit(EXIT_FAILURE);
+        }
+    }
+    stage->samples[stage->count++] = ns;
+}
+
+static bool readVarint(FILE* file, uint64_t* value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = getc(file);
+        if (byte == EOF)
+        {
+            return false;
+        }
+        *value |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int compareSamples(const void* a, const void* b)
+{
+    uint64_t x = *(const uint64_t*) a;
+    uint64_t y = *(const uint64_t*) b;
+    return x < y ? -1 : x > y;
+}
+
+static void printDuration(uint64_t ns)
+{
+    if (ns < 10000)
+    {
+        printf("%8luns", ns);
+    }
+    else if (ns < 10000000)
+    {
+        printf("%8.1fus", ns / 1e3);
+    }
+    else
+    {
+        printf("%8.1fms", ns / 1e6);
+    }
+}
+
+static void printStage(struct stage* stage)
+{
+    if (stage->count == 0)
+    {
+        return;
+    }
+
+    qsort(stage->samples, stage->count, sizeof(uint64_t), compareSamples);
+
+    printf("%s: %lu samples\n  min", stage->name, stage->count);
+    printDuration(stage->samples[0]);
+    printf("  p50");
+    printDuration(stage->samples[stage->count / 2]);
+    printf("  p99");
+    printDuration(stage->samples[stage->count * 99 / 100]);
+    printf("  max");
+    printDuration(stage->samples[stage->count - 1]);
+    printf("\n");
+
+    // Power of two buckets, bucket i holds samples below 2^i ns.
+    size_t buckets[HISTOGRAM_BUCKETS] = { 0 };
+    size_t largest = 0;
+    for (size_t i = 0; i < stage->count; i++)
+    {
+        int bucket = 0;
+        while (bucket < HISTOGRAM_BUCKETS - 1 && (1ULL << bucket) <= stage->samples[i])
+        {
+            bucket++;
+        }
+        buckets[bucket]++;
+        if (buckets[bucket] > largest)
+        {
+            largest = buckets[bucket];
+        }
+    }
+
+    for (int i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        if (buckets[i] == 0)
+        {
+            continue;
+        }
+
+        printf("  <");
+        printDuration(1ULL << i);
+        printf(" |");
+        int width = buckets[i] * 50 / largest;
+        for (int j = 0; j < width || j == 0; j++)
+        {
+            putchar('#');
+        }
+        printf(" %lu\n", buckets[i]);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s TRACE_FILE\n", argv[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(argv[1], "rb");
+    if (file == NULL)
+    {
+        perror("Could not open trace file! ");
+        return 1;
+    }
+
+    unsigned char header[13];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, TRACE_MAGIC, 4) != 0 || header[4] != TRACE_VERSION)
+    {
+        fprintf(stderr, "%s is not a trace file!\n", argv[1]);
+        return 1;
+    }
+
+    uint64_t now = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        now |= (uint64_t) header[5 + i] << (i * 8);
+    }
+
+    // Start times of the stages currently open, 0 if none is.
+    uint64_t key_ns = 0;
+    uint64_t refresh_ns = 0;
+    uint64_t complete_ns = 0;
+    uint64_t fork_ns = 0;
+    uint64_t dropped = 0;
+    uint64_t events = 0;
+
+    struct child children[MAX_CHILDREN];
+    int child_count = 0;
+
+    int type;
+    while ((type = getc(file)) != EOF)
+    {
+        uint64_t zigzag;
+        uint64_t arg;
+        if (!readVarint(file, &zigzag) || !readVarint(file, &arg))
+        {
+            fprintf(stderr, "Trace is truncated!\n");
+            break;
+        }
+
+        now += (int64_t) ((zigzag >> 1) ^ -(zigzag & 1));
+        events++;
+
+        switch (type)
+        {
+            case TRACE_KEY:
+                key_ns = now;
+                break;
+
+            case TRACE_REFRESH_START:
+                refresh_ns = now;
+                break;
+
+            case TRACE_REFRESH_END:
+                if (refresh_ns != 0)
+                {
+                    addSample(STAGE_REFRESH, now - refresh_ns);
+                    refresh_ns = 0;
+                }
+                if (key_ns != 0)
+                {
+                    addSample(STAGE_KEY, now - key_ns);
+                    key_ns = 0;
+                }
+                break;
+
+            case TRACE_COMPLETE_START:
+                complete_ns = now;
+                break;
+
+            case TRACE_COMPLETE_END:
+                if (complete_ns != 0)
+                {
+                    addSample(arg ? STAGE_SHADOW : STAGE_TAB, now - complete_ns);
+                    complete_ns = 0;
+                }
+                break;
+
+            case TRACE_FORK_START:
+                fork_ns = now;
+                break;
+
+            case TRACE_FORK_END:
+                if (fork_ns != 0)
+                {
+                    addSample(STAGE_FORK, now - fork_ns);
+                    fork_ns = 0;
+                }
+                if (child_count < MAX_CHILDREN)
+                {
+                    children[child_count].pid = arg;
+                    children[child_count].start_ns = now;
+                    child_count++;
+                }
+                break;
+
+            case TRACE_CHILD_EXIT:
+                for (int i = 0; i < child_count; i++)
+                {
+                    if (children[i].pid == arg)
+                    {
+                        addSample(STAGE_CHILD, now - children[i].start_ns);
+                        children[i] = children[--child_count];
+                        break;
+                    }
+                }
+                break;
+
+            case TRACE_DROPPED:
+                dropped += arg;
+                break;
+        }
+    }
+    fclose(file);
+
+    printf("%lu events", events);
+    if (dropped > 0)
+    {
+        printf(", %lu dropped", dropped);
+    }
+    printf("\n\n");
+
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        printStage(&stages[i]);
+    }
+
+    return 0;
+}
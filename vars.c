@@ -0,0 +1,283 @@
+#include "boone.h"
+
+struct vars_entry
+{
+    // "NAME=value", the same string the environment points to while the variable is exported.
+    char* binding;
+    size_t len;
+    uint64_t hash;
+
+    // Index in the environment, -1 if the variable isn't exported.
+    ssize_t exported;
+};
+
+static struct vars_entry* entries = NULL;
+static size_t entry_count = 0;
+static size_t entry_cap = 0;
+
+// Index of the entries by name, holding entry index + 1.
+static struct hash_index vars_index;
+
+// NULL terminated, NULL until the first variable is exported.
+static char** environment = NULL;
+static size_t environment_count = 0;
+static size_t environment_cap = 0;
+
+static struct vars_entry* varsLookup(const char* name, size_t len, uint64_t hash)
+{
+    struct hash_slot* slot = hashIndexFirst(&vars_index, hash);
+    for (; slot != NULL && slot->value != 0; slot = hashIndexNext(&vars_index, slot))
+    {
+        struct vars_entry* entry = &entries[slot->value - 1];
+        if (slot->hash == hash && entry->len == len && memcmp(entry->binding, name, len) == 0)
+        {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Reinserts every entry, first growing the index if they would fill more than half of it.
+static int varsRebuildIndex(void)
+{
+    if (entry_count * 2 + 2 > vars_index.cap && hashIndexReset(&vars_index, entry_count) == -1)
+    {
+        return -1;
+    }
+    hashIndexClear(&vars_index);
+
+    for (size_t i = 0; i < entry_count; i++)
+    {
+        hashIndexInsert(&vars_index, entries[i].hash, i + 1);
+    }
+    return 0;
+}
+
+static int varsExport(struct vars_entry* entry)
+{
+    if (entry->exported != -1)
+    {
+        return 0;
+    }
+
+    if (environment_count + 1 >= environment_cap)
+    {
+        size_t cap = environment_cap > 0 ? environment_cap * 2 : 64;
+        char** grown = realloc(environment, cap * sizeof(char*));
+        if (grown == NULL)
+        {
+            return -1;
+        }
+        environment = grown;
+        environment_cap = cap;
+    }
+
+    entry->exported = environment_count;
+    environment[environment_count++] = entry->binding;
+    environment[environment_count] = NULL;
+    return 0;
+}
+
+void varsInit(char** envp)
+{
+    for (int i = 0; envp[i] != NULL; i++)
+    {
+        char* equals = strchr(envp[i], '=');
+        if (equals != NULL && equals != envp[i])
+        {
+            varsSet(envp[i], equals - envp[i], equals + 1, true);
+        }
+    }
+}
+
+const char* varsGet(const char* name, size_t len)
+{
+    struct vars_entry* entry = varsLookup(name, len, hashBytes(name, len));
+    return entry != NULL ? entry->binding + len + 1 : NULL;
+}
+
+int varsSet(const char* name, size_t len, const char* value, bool export)
+{
+    size_t value_len = strlen(value);
+    char* binding = malloc(len + value_len + 2);
+    if (binding == NULL)
+    {
+        return -1;
+    }
+    memcpy(binding, name, len);
+    binding[len] = '=';
+    memcpy(binding + len + 1, value, value_len + 1);
+
+    uint64_t hash = hashBytes(name, len);
+    struct vars_entry* entry = varsLookup(name, len, hash);
+
+    if (entry == NULL)
+    {
+        if (entry_count == entry_cap)
+        {
+            size_t cap = entry_cap > 0 ? entry_cap * 2 : 64;
+            struct vars_entry* grown = realloc(entries, cap * sizeof(struct vars_entry));
+            if (grown == NULL)
+            {
+                free(binding);
+                return -1;
+            }
+            entries = grown;
+            entry_cap = cap;
+        }
+
+        entry = &entries[entry_count++];
+        entry->binding = binding;
+        entry->len = len;
+        entry->hash = hash;
+        entry->exported = -1;
+
+        if (entry_count * 2 + 2 > vars_index.cap)
+        {
+            if (varsRebuildIndex() == -1)
+            {
+                entry_count--;
+                free(binding);
+                return -1;
+            }
+        }
+        else
+        {
+            hashIndexInsert(&vars_index, hash, entry_count);
+        }
+    }
+    else
+    {
+        // Only this slot of the environment changes, the rest of it is kept as it is.
+        free(entry->binding);
+        entry->binding = binding;
+        if (entry->exported != -1)
+        {
+            environment[entry->exported] = binding;
+        }
+    }
+
+    return export ? varsExport(entry) : 0;
+}
+
+void varsUnset(const char* name, size_t len)
+{
+    struct vars_entry* entry = varsLookup(name, len, hashBytes(name, len));
+    if (entry == NULL)
+    {
+        return;
+    }
+
+    // The last exported variable takes its place in the environment.
+    if (entry->exported != -1)
+    {
+        char* last = environment[--environment_count];
+        environment[environment_count] = NULL;
+        if (last != entry->binding)
+        {
+            size_t last_len = strchr(last, '=') - last;
+            varsLookup(last, last_len, hashBytes(last, last_len))->exported = entry->exported;
+            environment[entry->exported] = last;
+        }
+    }
+
+    // Likewise the last entry, after which the index is rebuilt. It only ever grows, so that can't fail.
+    free(entry->binding);
+    *entry = entries[--entry_count];
+    varsRebuildIndex();
+}
+
+size_t varsNameLength(const char* text)
+{
+    if (!isalpha((unsigned char) text[0]) && text[0] != '_')
+    {
+        return 0;
+    }
+
+    size_t len = 1;
+    while (isalnum((unsigned char) text[len]) || text[len] == '_')
+    {
+        len++;
+    }
+    return len;
+}
+
+char** varsEnvironment(void)
+{
+    return environment != NULL ? environment : environ;
+}
+
+bool varsAssign(char** args)
+{
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        size_t len = varsNameLength(args[i]);
+        if (len == 0 || args[i][len] != '=')
+        {
+            return false;
+        }
+    }
+
+    for (int i = 0; args[i] != NULL; i++)
+    {
+        size_t len = varsNameLength(args[i]);
+        if (varsSet(args[i], len, args[i] + len + 1, false) == -1)
+        {
+            perror("Could not set variable! ");
+        }
+    }
+    return true;
+}
+
+int shell_export(char** args)
+{
+    if (args[1] == NULL)
+    {
+        for (size_t i = 0; i < environment_count; i++)
+        {
+            printf("\r%s\n", environment[i]);
+        }
+        return 0;
+    }
+
+    int status = 0;
+    for (int i = 1; args[i] != NULL; i++)
+    {
+        size_t len = varsNameLength(args[i]);
+        if (len == 0 || (args[i][len] != '=' && args[i][len] != '\0'))
+        {
+            fprintf(stderr, "\rNot a valid variable name: %s!\n", args[i]);
+            status = 1;
+            continue;
+        }
+
+        int result = 0;
+        if (args[i][len] == '=')
+        {
+            result = varsSet(args[i], len, args[i] + len + 1, true);
+        }
+        else
+        {
+            // Exporting a variable that was never set does nothing.
+            struct vars_entry* entry = varsLookup(args[i], len, hashBytes(args[i], len));
+            result = entry != NULL ? varsExport(entry) : 0;
+        }
+
+        if (result == -1)
+        {
+            perror("Could not export variable! ");
+            status = 1;
+        }
+    }
+
+    return status;
+}
+
+int shell_unset(char** args)
+{
+    for (int i = 1; args[i] != NULL; i++)
+    {
+        varsUnset(args[i], strlen(args[i]));
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+#ifndef VARS_H
+#define VARS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Shell variables live in one hashed table, each as a single "NAME=value"
+ * string. The exported ones are also kept in a NULL terminated array of those
+ * same strings, which is the environment every program is started with. It is
+ * patched in place whenever an export changes rather than rebuilt, and the
+ * child's copy of it comes for free with fork.
+ */
+
+// Imports the environment the shell was started with, every variable exported.
+void varsInit(char** envp);
+
+// Returns the value of the variable whose name is the len bytes at name, or NULL if it isn't set.
+const char* varsGet(const char* name, size_t len);
+
+// Looks a variable up by a string literal name.
+#define VARS_GET(name) varsGet(name, sizeof(name) - 1)
+
+// Sets a variable, exporting it as well if export is true. Exported variables stay exported. Returns -1 on error.
+int varsSet(const char* name, size_t len, const char* value, bool export);
+
+void varsUnset(const char* name, size_t len);
+
+// Length of the variable name at the start of text, 0 if it doesn't start with one.
+size_t varsNameLength(const char* text);
+
+// The environment for programs started by the shell.
+char** varsEnvironment(void);
+
+/**
+ * Sets every NAME=value argument as a shell variable if that is all the line
+ * holds. Returns false, setting nothing, if anything else is in it.
+ */
+bool varsAssign(char** args);
+
+// Sets and exports NAME=value arguments and exports NAME ones, or lists the environment without any.
+int shell_export(char** args);
+int shell_unset(char** args);
+
+#endif
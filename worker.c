@@ -0,0 +1,86 @@
+#include "worker.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+struct worker_job
+{
+    void (*fn)(void*);
+    void* arg;
+    struct worker_job* next;
+};
+
+static pthread_mutex_t worker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_cond = PTHREAD_COND_INITIALIZER;
+static struct worker_job* worker_head = NULL;
+static struct worker_job* worker_tail = NULL;
+static bool worker_started = false;
+
+static void* workerLoop(void* unused)
+{
+    while (true)
+    {
+        pthread_mutex_lock(&worker_lock);
+        while (worker_head == NULL)
+        {
+            pthread_cond_wait(&worker_cond, &worker_lock);
+        }
+
+        struct worker_job* job = worker_head;
+        worker_head = job->next;
+        if (worker_head == NULL)
+        {
+            worker_tail = NULL;
+        }
+        pthread_mutex_unlock(&worker_lock);
+
+        job->fn(job->arg);
+        free(job);
+    }
+
+    return NULL;
+}
+
+int workerSubmit(void (*fn)(void*), void* arg)
+{
+    struct worker_job* job = malloc(sizeof(struct worker_job));
+    if (job == NULL)
+    {
+        perror("Could not allocate! ");
+        return -1;
+    }
+    job->fn = fn;
+    job->arg = arg;
+    job->next = NULL;
+
+    pthread_mutex_lock(&worker_lock);
+    if (!worker_started)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, workerLoop, NULL) != 0)
+        {
+            pthread_mutex_unlock(&worker_lock);
+            perror("Could not start worker thread! ");
+            free(job);
+            return -1;
+        }
+        pthread_detach(thread);
+        worker_started = true;
+    }
+
+    if (worker_tail == NULL)
+    {
+        worker_head = job;
+    }
+    else
+    {
+        worker_tail->next = job;
+    }
+    worker_tail = job;
+
+    pthread_cond_signal(&worker_cond);
+    pthread_mutex_unlock(&worker_lock);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+/**
+ * A single background thread that runs jobs in submission order. Used for
+ * work that must never block the prompt, like compacting the history file.
+ */
+
+/**
+ * Queues fn(arg) to run on the worker thread, starting the thread on first use.
+ * Returns -1 if the job couldn't be queued, in which case arg is still the caller's.
+ */
+int workerSubmit(void (*fn)(void*), void* arg);
+
+#endif